@@ -19,15 +19,39 @@
 #include <ctime>
 #include <vector>
 #include <algorithm>
+#include <cstdint>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 
 const bool WHITE = false;
 const bool BLACK = true;
-const unsigned short MAX_CHECKING_PIECES = 2;
-const unsigned short MAX_MOVES = 30;
-char FEN[90]{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" };
-
-bool player_to_move = WHITE;
-bool castle[4]{ true };
+const unsigned short MAX_MOVES = 256; //the most moves known in a legal position is 218
+const unsigned short MAX_UNDO = 1024; //must be a power of two
+const unsigned short MAX_FEN_LENGTH = 100; //92 characters plus the terminating zero is the longest a FEN can get
+const char FEN[]{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" }; //the classic starting position
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -45,6 +69,7 @@ enum class results {
 enum class causes {
 	GAME_IN_PROGRESS = -1,
 	CHECKMATE,
+	STALEMATE,
 	RESIGNATION,
 	AGREEMENT_TO_A_DRAW,
 	UNSUFFICIENT_MATERIAL,
@@ -63,8 +88,6 @@ struct game_results {
 	game_results() : result(results::GAME_IN_PROGRESS), cause(causes::GAME_IN_PROGRESS) {};
 };
 
-game_results game_result;
-
 enum piece_types {
 	EMPTY,
 	KING,
@@ -84,8 +107,6 @@ enum class game_types {
 	KING_OF_THE_HILL,
 };
 
-game_types game_type;
-
 enum move_types {
 	NO_CAPTURE = 1,
 	CAPTURE,
@@ -123,1334 +144,932 @@ bool operator== (const Position& lhs, const Position& rhs) {
 	return (lhs.file == rhs.file) && (lhs.rank == rhs.rank);
 }
 
-bool en_passant = false;
-
-Position en_passant_position(-1, -1);
-
-unsigned short en_passant_cnt = 0;
-
-class Moves {
+class Move {//source (6 bits), destination (6 bits) and flags (4 bits) packed into 16 bits
 private:
 
-	struct move {
-		Position destination;
-		move_types move_type;
-
-		move() : destination(-1, -1), move_type(NO_CAPTURE) {};
-		move(short file, short rank, move_types type) : destination(file, rank), move_type(type) {};
+	std::uint16_t data;
+
+	enum flags {
+		QUIET_FLAG = 0,
+		LONG_PAWN_MOVE_FLAG = 1,
+		CASTLES_FLAG = 2,
+		PLACEMENT_FLAG = 3,
+		CAPTURE_FLAG = 4,
+		EN_PASSANT_FLAG = 5,
+		PROMOTION_FLAG = 8, //+ promotion piece - QUEEN
+		CAPTURE_WITH_PROMOTION_FLAG = 12, //+ promotion piece - QUEEN
 	};
 
-	move move_list[MAX_MOVES];
-
-	unsigned short move_cnt;
-
 public:
 
-	Moves() {
-		move_cnt = 0;
-	}
-
-	~Moves() {
-		move_cnt = 0;
-		for (auto i = 0; i < MAX_MOVES; ++i) {
-			move_list[i].move_type = NO_CAPTURE;
-			move_list[i].destination.file = -1;
-			move_list[i].destination.rank = -1;
+	Move() : data(0) {};
+	Move(int source, int destination, move_types type, piece_types promotion = QUEEN) {
+		unsigned flag;
+		switch (type) {
+		case CAPTURE:
+			flag = CAPTURE_FLAG;
+			break;
+		case PROMOTION:
+			flag = PROMOTION_FLAG + promotion - QUEEN;
+			break;
+		case CAPTURE_WITH_PROMOTION:
+			flag = CAPTURE_WITH_PROMOTION_FLAG + promotion - QUEEN;
+			break;
+		case EN_PASSANT:
+			flag = EN_PASSANT_FLAG;
+			break;
+		case LONG_PAWN_MOVE:
+			flag = LONG_PAWN_MOVE_FLAG;
+			break;
+		case CASTLES:
+			flag = CASTLES_FLAG;
+			break;
+		case PLACEMENT:
+			flag = PLACEMENT_FLAG;
+			break;
+		default:
+			flag = QUIET_FLAG;
+			break;
 		}
+		data = static_cast<std::uint16_t>(source | destination << 6 | flag << 12);
 	}
 
-	void add(short file, short rank, move_types type) {
-		move_list[move_cnt] = move(file, rank, type);
-		move_cnt++;
+	int source() const {
+		return data & 63;
 	}
 
-	void clear() {
-		move_cnt = 0;
+	int destination() const {
+		return (data >> 6) & 63;
 	}
 
-	unsigned short amount() {
-		return move_cnt;
+	move_types move_type() const {
+		unsigned flag = data >> 12;
+		if (flag >= CAPTURE_WITH_PROMOTION_FLAG) return CAPTURE_WITH_PROMOTION;
+		if (flag >= PROMOTION_FLAG) return PROMOTION;
+		switch (flag) {
+		case CAPTURE_FLAG:
+			return CAPTURE;
+		case EN_PASSANT_FLAG:
+			return EN_PASSANT;
+		case LONG_PAWN_MOVE_FLAG:
+			return LONG_PAWN_MOVE;
+		case CASTLES_FLAG:
+			return CASTLES;
+		case PLACEMENT_FLAG:
+			return PLACEMENT;
+		default:
+			return NO_CAPTURE;
+		}
 	}
 
-	move& operator[] (const int index) {
-		if (index < 0 || index > move_cnt) throw "Invalid index";
-		return move_list[index];
+	piece_types promotion() const {
+		return data >> 12 >= PROMOTION_FLAG ? static_cast<piece_types>(QUEEN + ((data >> 12) & 3)) : EMPTY;
 	}
-};
-
-class piece {
-protected:
-
-	Position position;
 
-	bool color;
-
-	bool promoted;
-
-public:
-
-	Moves moves;
-
-	virtual void find(bool mark) = 0;
+	bool is_capture() const {
+		unsigned flag = data >> 12;
+		return flag == CAPTURE_FLAG || flag == EN_PASSANT_FLAG || flag >= CAPTURE_WITH_PROMOTION_FLAG;
+	}
 
-	virtual bool get_color() {
-		return color;
+	std::uint16_t raw() const {
+		return data;
 	}
 
-	virtual bool is_promoted() {
-		return promoted;
+	static Move from_raw(std::uint16_t raw) {
+		Move move;
+		move.data = raw;
+		return move;
 	}
 
-	virtual void set_position(short file, short rank) {
-		position.file = file;
-		position.rank = rank;
+	friend bool operator== (const Move& lhs, const Move& rhs) {
+		return lhs.data == rhs.data;
 	}
 
-	virtual piece_types type() = 0;
+	friend bool operator!= (const Move& lhs, const Move& rhs) {
+		return lhs.data != rhs.data;
+	}
 };
 
-class square {
+static_assert(sizeof(Move) == 2, "Move must stay packed into 16 bits");
+
+class Move_list {//all moves of a position in one flat array, meant to live on the stack
 private:
 
-	bool is_occupied;
+	Move move_list[MAX_MOVES];
 
-	int attacked;
+	unsigned short move_cnt;
 
 public:
 
-	piece* _piece;
+	Move_list() {
+		move_cnt = 0;
+	}
 
-	bool color() {
-		return _piece->get_color();
+	void add(Move move) {
+		assert(move_cnt < MAX_MOVES);
+		move_list[move_cnt++] = move;
 	}
 
-	bool occupied() {
-		bool res;
-		_piece->type() == EMPTY ? res = false : res = true;
-		return res;
+	void clear() {
+		move_cnt = 0;
 	}
 
-	void attack() {
-		++attacked;
+	unsigned short amount() const {
+		return move_cnt;
 	}
 
-	void unattack() {
-		attacked = 0;
+	Move& operator[] (const int index) {
+		return move_list[index];
 	}
 
-	bool is_attacked() {
-		return static_cast<bool>(attacked);
+	Move* begin() {
+		return move_list;
 	}
 
-	piece_types piece_type() {
-		return _piece->type();
+	Move* end() {
+		return move_list + move_cnt;
 	}
 };
 
-square board[8][8];
+struct Undo {//everything make_move() changes that cannot be recomputed from the move itself
+	Move move;
+	piece_types captured;
+	bool captured_promoted;
+	bool castle[4];
+	bool en_passant;
+	Position en_passant_position;
+	unsigned short halfmove_clock;
+	std::uint64_t key;
+};
+
+typedef std::uint64_t bitboard;
 
-class Checking_pieces {
-private:
+inline bitboard square_bb(int file, int rank) {
+	return 1ULL << (rank * 8 + file);
+}
+
+inline int lsb(bitboard b) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, b);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctzll(b);
+#endif
+}
 
-	struct ch_p {
-		Position position;
-		piece_types piece_type;
+inline int msb(bitboard b) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, b);
+	return static_cast<int>(index);
+#else
+	return 63 - __builtin_clzll(b);
+#endif
+}
 
-		ch_p() : position(-1, -1), piece_type(EMPTY) {};
-		ch_p(short file, short rank, piece_types type) : position(file, rank), piece_type(type) {};
-	};
+inline int pop_lsb(bitboard& b) {
+	int index = lsb(b);
+	b &= b - 1;
+	return index;
+}
 
-	ch_p piece_list[MAX_CHECKING_PIECES];
+inline int popcount(bitboard b) {
+#if defined(_MSC_VER)
+	return static_cast<int>(__popcnt64(b));
+#else
+	return __builtin_popcountll(b);
+#endif
+}
 
-	unsigned short piece_cnt;
+inline Position square_position(int index) {
+	return Position(index % 8, index / 8);
+}
 
+class Magic {
 public:
 
-	Checking_pieces() {
-		piece_cnt = 0;
+	bitboard mask;
+
+	bitboard magic;
+
+	bitboard* attacks;
+
+	unsigned shift;
+
+	unsigned index(bitboard occupied) const {
+#if defined(__BMI2__)
+		return static_cast<unsigned>(_pext_u64(occupied, mask));
+#else
+		return static_cast<unsigned>(((occupied & mask) * magic) >> shift);
+#endif
 	}
+};
+
+Magic bishop_magics[64];
+Magic rook_magics[64];
 
-	~Checking_pieces() {
-		piece_cnt = 0;
-		for (auto i = 0; i < MAX_CHECKING_PIECES; ++i) {
-			piece_list[i].piece_type = EMPTY;
-			piece_list[i].position.file = -1;
-			piece_list[i].position.rank = -1;
+bitboard bishop_table[0x1480];
+bitboard rook_table[0x19000];
+
+const int bishop_directions[4][2]{ { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+const int rook_directions[4][2]{ { 0, 1 }, { 0, -1 }, { 1, 0 }, { -1, 0 } };
+
+bitboard sliding_attacks(int square, bitboard occupied, const int directions[4][2]) {//slow ray walk, only used to fill the tables
+	bitboard attacks = 0;
+	for (auto d = 0; d < 4; ++d) {
+		auto i = square % 8 + directions[d][0];
+		auto j = square / 8 + directions[d][1];
+		for (; i >= 0 && i < 8 && j >= 0 && j < 8; i += directions[d][0], j += directions[d][1]) {
+			attacks |= square_bb(i, j);
+			if (occupied & square_bb(i, j)) break;
 		}
 	}
+	return attacks;
+}
 
-	void add(short file, short rank, piece_types type) {
-		piece_list[piece_cnt] = ch_p(file, rank, type);
-		piece_cnt++;
-	}
+std::uint64_t random_state = 1070372ULL;
 
-	void clear() {
-		piece_cnt = 0;
-	}
+std::uint64_t random_number() {//xorshift64*, fixed seed so that the tables are the same on every run
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state * 2685821657736338717ULL;
+}
 
-	unsigned short amount() {
-		return piece_cnt;
+const std::uint64_t magic_seeds[8]{ 728, 10316, 55013, 32803, 12281, 15100, 16645, 255 }; //per rank, known to find magics quickly
+
+void initialize_magics(Magic magics[64], bitboard* table, const int directions[4][2]) {
+	bitboard occupancies[4096], references[4096];
+	bitboard* attacks = table;
+	for (auto square = 0; square < 64; ++square) {
+		bitboard edges = ((0xFFULL | 0xFFULL << 56) & ~(0xFFULL << (square / 8 * 8))) |
+			((0x0101010101010101ULL | 0x8080808080808080ULL) & ~(0x0101010101010101ULL << (square % 8)));
+		Magic& m = magics[square];
+		m.mask = sliding_attacks(square, 0, directions) & ~edges;
+		m.shift = 64 - popcount(m.mask);
+		m.attacks = attacks;
+		int size = 0;
+		bitboard subset = 0;
+		do {//enumerate all subsets of the mask (Carry-Rippler)
+			occupancies[size] = subset;
+			references[size] = sliding_attacks(square, subset, directions);
+			++size;
+			subset = (subset - m.mask) & m.mask;
+		} while (subset);
+		attacks += size;
+#if defined(__BMI2__)
+		for (auto i = 0; i < size; ++i) m.attacks[m.index(occupancies[i])] = references[i];
+#else
+		int epochs[4096]{}, epoch = 0; //epochs[index] == epoch marks entries already filled for the current candidate
+		random_state = magic_seeds[square / 8];
+		for (auto i = 0; i < size;) {
+			do {
+				m.magic = random_number() & random_number() & random_number();
+			} while (popcount((m.mask * m.magic) >> 56) < 6);
+			++epoch;
+			for (i = 0; i < size; ++i) {
+				unsigned index = m.index(occupancies[i]);
+				if (epochs[index] < epoch) {
+					epochs[index] = epoch;
+					m.attacks[index] = references[i];
+				}
+				else if (m.attacks[index] != references[i]) break;
+			}
+		}
+#endif
 	}
+}
 
-	ch_p& operator[] (const int index) {
-		if (index < 0 || index > piece_cnt) throw "Invalid index";
-		return piece_list[index];
-	}
-};
+inline bitboard bishop_attacks(int square, bitboard occupied) {
+	const Magic& m = bishop_magics[square];
+	return m.attacks[m.index(occupied)];
+}
 
-Checking_pieces checking_pieces;
+inline bitboard rook_attacks(int square, bitboard occupied) {
+	const Magic& m = rook_magics[square];
+	return m.attacks[m.index(occupied)];
+}
 
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+inline bitboard queen_attacks(int square, bitboard occupied) {
+	return bishop_attacks(square, occupied) | rook_attacks(square, occupied);
+}
 
-class pawn :public piece {
-public:
+constexpr int knight_offsets[8][2]{ { 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 }, { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 } };
+constexpr int king_offsets[8][2]{ { 0, 1 }, { 1, 1 }, { 1, 0 }, { 1, -1 }, { 0, -1 }, { -1, -1 }, { -1, 0 }, { -1, 1 } };
+constexpr int white_pawn_offsets[2][2]{ { -1, 1 }, { 1, 1 } };
+constexpr int black_pawn_offsets[2][2]{ { -1, -1 }, { 1, -1 } };
+
+template <int N>
+constexpr std::array<bitboard, 64> leaper_table(const int (&offsets)[N][2]) {
+	std::array<bitboard, 64> table{};
+	for (auto square = 0; square < 64; ++square) {
+		for (auto k = 0; k < N; ++k) {
+			auto i = square % 8 + offsets[k][0];
+			auto j = square / 8 + offsets[k][1];
+			if (i >= 0 && i < 8 && j >= 0 && j < 8) table[square] |= 1ULL << (j * 8 + i);
+		}
+	}
+	return table;
+}
 
-	pawn(bool color, short new_file, short new_rank) {
-		position.file = new_file;
-		position.rank = new_rank;
-		this->color = color;
-		this->promoted = false;
-	};
+constexpr std::array<bitboard, 64> knight_attacks = leaper_table(knight_offsets);
+constexpr std::array<bitboard, 64> king_attacks = leaper_table(king_offsets);
+constexpr std::array<bitboard, 64> pawn_attacks[2]{ leaper_table(white_pawn_offsets), leaper_table(black_pawn_offsets) };
 
-	virtual void find(bool mark) {
-		if (!get_color()) {// 
-			auto i = position.file;
-			auto j = position.rank + 1;
-			if (mark) {
-				i = position.file + 1;
-				if (i < 8) {
-					board[i][j].attack();
-					if (board[i][j].piece_type() == KING && board[i][j].color() != get_color()) checking_pieces.add(i, j, PAWN);
-				}
-				i = position.file - 1;
-				if (i >= 0) {
-					board[i][j].attack();
-					if (board[i][j].piece_type() == KING && board[i][j].color() != get_color()) checking_pieces.add(i, j, PAWN);
-				}
-			}
-			else {
-				if (!board[i][j].occupied()) {
-					j == 7 ? moves.add(i, j, PROMOTION) : moves.add(i, j, NO_CAPTURE);
-					if ((position.rank == 1) && !board[i][j + 1].occupied()) moves.add(i, j + 1, LONG_PAWN_MOVE);
-				}
-				i = position.file + 1;
-				if (i < 8) {
-					if (board[i][j].occupied() && (board[i][j].color() != player_to_move)) {
-						j == 7 ? moves.add(i, j, CAPTURE_WITH_PROMOTION) : moves.add(i, j, CAPTURE);
-					}
-				}
-				i = position.file - 1;
-				if (i >= 0) {
-					if (board[i][j].occupied() && (board[i][j].color() != player_to_move)) {
-						j == 7 ? moves.add(i, j, CAPTURE_WITH_PROMOTION) : moves.add(i, j, CAPTURE);
-					}
-				}
-				if (en_passant && (position.rank == 4)) {//  
-					if ((en_passant_position.file == position.file + 1) || (en_passant_position.file == position.file - 1)) {
-						moves.add(en_passant_position.file, en_passant_position.rank, EN_PASSANT);
-					}
-				}
-			}
-		}
-		if (get_color()) {// 
-			auto i = position.file;
-			auto j = position.rank - 1;
-			if (mark) {
-				i = position.file + 1;
-				if (i < 8) {
-					board[i][j].attack();
-					if (board[i][j].piece_type() == KING && board[i][j].color() != get_color()) checking_pieces.add(i, j, PAWN);
-				}
-				i = position.file - 1;
-				if (i >= 0) {
-					board[i][j].attack();
-					if (board[i][j].piece_type() == KING && board[i][j].color() != get_color()) checking_pieces.add(i, j, PAWN);
-				}
+bitboard between_bb[64][64]; //squares strictly between two squares on a common line
+bitboard line_bb[64][64]; //the whole line through two squares
+
+void initialize_attack_tables() {
+	initialize_magics(bishop_magics, bishop_table, bishop_directions);
+	initialize_magics(rook_magics, rook_table, rook_directions);
+	for (auto a = 0; a < 64; ++a) {
+		for (auto b = 0; b < 64; ++b) {
+			between_bb[a][b] = line_bb[a][b] = 0;
+			if (a == b) continue;
+			if (bishop_attacks(a, 0) & (1ULL << b)) {
+				line_bb[a][b] = (bishop_attacks(a, 0) & bishop_attacks(b, 0)) | (1ULL << a) | (1ULL << b);
+				between_bb[a][b] = bishop_attacks(a, 1ULL << b) & bishop_attacks(b, 1ULL << a);
 			}
-			else {
-				if (!board[i][j].occupied()) {
-					j == 7 ? moves.add(i, j, PROMOTION) : moves.add(i, j, NO_CAPTURE);
-					if ((position.rank == 6) && !board[i][j - 1].occupied()) moves.add(i, j - 1, LONG_PAWN_MOVE);
-				}
-				i = position.file + 1;
-				if (i < 8) {
-					if (board[i][j].occupied() && (board[i][j].color() != player_to_move)) {
-						j == 7 ? moves.add(i, j, CAPTURE_WITH_PROMOTION) : moves.add(i, j, CAPTURE);
-					}
-				}
-				i = position.file - 1;
-				if (i >= 0) {
-					if (board[i][j].occupied() && (board[i][j].color() != player_to_move)) {
-						j == 7 ? moves.add(i, j, CAPTURE_WITH_PROMOTION) : moves.add(i, j, CAPTURE);
-					}
-				}
-				if (en_passant && (position.rank == 3)) {
-					if ((en_passant_position.file == position.file + 1) || (en_passant_position.file == position.file - 1)) {
-						moves.add(en_passant_position.file, en_passant_position.rank, EN_PASSANT);
-					}
-				}
+			if (rook_attacks(a, 0) & (1ULL << b)) {
+				line_bb[a][b] = (rook_attacks(a, 0) & rook_attacks(b, 0)) | (1ULL << a) | (1ULL << b);
+				between_bb[a][b] = rook_attacks(a, 1ULL << b) & rook_attacks(b, 1ULL << a);
 			}
 		}
 	}
+}
 
-	virtual piece_types type() {
-		return PAWN;
-	}
+struct Zobrist_keys {
+	std::uint64_t pieces[2][7][64];
+	std::uint64_t castle[4];
+	std::uint64_t en_passant[8]; //by file
+	std::uint64_t side; //black to move
 };
-//        ,      ,
-			//            
-class king :public piece {
-public:
 
-	king(bool color, short new_file, short new_rank) {
-		position.file = new_file;
-		position.rank = new_rank;
-		this->color = color;
-		this->promoted = false;
-	};
+constexpr std::uint64_t splitmix64(std::uint64_t& state) {
+	std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
 
-	virtual void find(bool mark) {
-		if (mark) {
-			auto i = position.file + 1;
-			auto j = position.rank;
-			if (i < 8) {
-				board[i][j].attack();
-			}
-			i = position.file - 1;
-			if (i >= 0) {
-				board[i][j].attack();
-			}
-			i = position.file;
-			j = position.rank - 1;
-			if (j >= 0) {
-				board[i][j].attack();
-			}
-			j = position.rank + 1;
-			if (j < 8) {
-				board[i][j].attack();
-			}
-			i = position.file + 1;
-			if (i < 8 && j < 8) {
-				board[i][j].attack();
-			}
-			i = position.file + 1;
-			j = position.rank - 1;
-			if (i < 8 && j >= 0) {
-				board[i][j].attack();
-			}
-			i = position.file - 1;
-			j = position.rank + 1;
-			if (j < 8 && i >= 0) {
-				board[i][j].attack();
-			}
-			i = position.file - 1;
-			j = position.rank - 1;
-			if (i >= 0 && j >= 0) {
-				board[i][j].attack();
-			}
-		}
-		else {
-			auto i = position.file + 1;
-			auto j = position.rank;
-			if (!board[i][j].is_attacked() && i < 8) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) moves.add(i, j, CAPTURE);
-				}
-			}
-			i = position.file - 1;
-			if (!board[i][j].is_attacked() && i >= 0) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) moves.add(i, j, CAPTURE);
-				}
-			}
-			i = position.file;
-			j = position.rank - 1;
-			if (!board[i][j].is_attacked() && j >= 0) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) moves.add(i, j, CAPTURE);
-				}
-			}
-			j = position.rank + 1;
-			if (!board[i][j].is_attacked() && j < 8) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) moves.add(i, j, CAPTURE);
-				}
-			}
-			i = position.file + 1;
-			if (!board[i][j].is_attacked() && i < 8 && j < 8) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) moves.add(i, j, CAPTURE);
-				}
-			}
-			i = position.file + 1;
-			j = position.rank - 1;
-			if (!board[i][j].is_attacked() && i < 8 && j >= 0) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) moves.add(i, j, CAPTURE);
-				}
-			}
-			i = position.file - 1;
-			j = position.rank + 1;
-			if (!board[i][j].is_attacked() && j < 8 && i >= 0) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) moves.add(i, j, CAPTURE);
-				}
-			}
-			i = position.file - 1;
-			j = position.rank - 1;
-			if (!board[i][j].is_attacked() && i >= 0 && j >= 0) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) moves.add(i, j, CAPTURE);
-				}
-			}
+constexpr Zobrist_keys zobrist_table() {//built by the compiler, so keys are the same on every run and every machine
+	Zobrist_keys keys{};
+	std::uint64_t state = 0x5D1A2E6B3C4F7081ULL;
+	for (auto color = 0; color < 2; ++color) {
+		for (auto type = 0; type < 7; ++type) {
+			for (auto square = 0; square < 64; ++square) keys.pieces[color][type][square] = splitmix64(state);
 		}
 	}
+	for (auto i = 0; i < 4; ++i) keys.castle[i] = splitmix64(state);
+	for (auto i = 0; i < 8; ++i) keys.en_passant[i] = splitmix64(state);
+	keys.side = splitmix64(state);
+	return keys;
+}
+
+constexpr Zobrist_keys zobrist = zobrist_table();
+
+const int MAX_PHASE = 24; //all minor pieces, rooks and queens on the board
+const int phase_weights[7]{ 0, 0, 4, 2, 1, 1, 0 }; //by piece_types
+const short material_mg[7]{ 0, 0, 1025, 477, 365, 337, 82 };
+const short material_eg[7]{ 0, 0, 936, 512, 297, 281, 94 };
+
+constexpr short psq_mg[7][64]{//from white's side, a8 first
+	{},
+	{//king: stay behind the pawns
+		-30, -40, -40, -50, -50, -40, -40, -30,
+		-30, -40, -40, -50, -50, -40, -40, -30,
+		-30, -40, -40, -50, -50, -40, -40, -30,
+		-30, -40, -40, -50, -50, -40, -40, -30,
+		-20, -30, -30, -40, -40, -30, -30, -20,
+		-10, -20, -20, -20, -20, -20, -20, -10,
+		 20,  20,   0,   0,   0,   0,  20,  20,
+		 20,  30,  10,   0,   0,  10,  30,  20 },
+	{//queen
+		-20, -10, -10,  -5,  -5, -10, -10, -20,
+		-10,   0,   0,   0,   0,   0,   0, -10,
+		-10,   0,   5,   5,   5,   5,   0, -10,
+		 -5,   0,   5,   5,   5,   5,   0,  -5,
+		  0,   0,   5,   5,   5,   5,   0,  -5,
+		-10,   5,   5,   5,   5,   5,   0, -10,
+		-10,   0,   5,   0,   0,   0,   0, -10,
+		-20, -10, -10,  -5,  -5, -10, -10, -20 },
+	{//rook
+		  0,   0,   0,   0,   0,   0,   0,   0,
+		  5,  10,  10,  10,  10,  10,  10,   5,
+		 -5,   0,   0,   0,   0,   0,   0,  -5,
+		 -5,   0,   0,   0,   0,   0,   0,  -5,
+		 -5,   0,   0,   0,   0,   0,   0,  -5,
+		 -5,   0,   0,   0,   0,   0,   0,  -5,
+		 -5,   0,   0,   0,   0,   0,   0,  -5,
+		  0,   0,   0,   5,   5,   0,   0,   0 },
+	{//bishop
+		-20, -10, -10, -10, -10, -10, -10, -20,
+		-10,   0,   0,   0,   0,   0,   0, -10,
+		-10,   0,   5,  10,  10,   5,   0, -10,
+		-10,   5,   5,  10,  10,   5,   5, -10,
+		-10,   0,  10,  10,  10,  10,   0, -10,
+		-10,  10,  10,  10,  10,  10,  10, -10,
+		-10,   5,   0,   0,   0,   0,   5, -10,
+		-20, -10, -10, -10, -10, -10, -10, -20 },
+	{//knight
+		-50, -40, -30, -30, -30, -30, -40, -50,
+		-40, -20,   0,   0,   0,   0, -20, -40,
+		-30,   0,  10,  15,  15,  10,   0, -30,
+		-30,   5,  15,  20,  20,  15,   5, -30,
+		-30,   0,  15,  20,  20,  15,   0, -30,
+		-30,   5,  10,  15,  15,  10,   5, -30,
+		-40, -20,   0,   5,   5,   0, -20, -40,
+		-50, -40, -30, -30, -30, -30, -40, -50 },
+	{//pawn
+		  0,   0,   0,   0,   0,   0,   0,   0,
+		 50,  50,  50,  50,  50,  50,  50,  50,
+		 10,  10,  20,  30,  30,  20,  10,  10,
+		  5,   5,  10,  25,  25,  10,   5,   5,
+		  0,   0,   0,  20,  20,   0,   0,   0,
+		  5,  -5, -10,   0,   0, -10,  -5,   5,
+		  5,  10,  10, -20, -20,  10,  10,   5,
+		  0,   0,   0,   0,   0,   0,   0,   0 },
+};
+
+constexpr short king_eg[64]{//the king walks to the centre once the queens are gone
+	-50, -40, -30, -20, -20, -30, -40, -50,
+	-30, -20, -10,   0,   0, -10, -20, -30,
+	-30, -10,  20,  30,  30,  20, -10, -30,
+	-30, -10,  30,  40,  40,  30, -10, -30,
+	-30, -10,  30,  40,  40,  30, -10, -30,
+	-30, -10,  20,  30,  30,  20, -10, -30,
+	-30, -30,   0,   0,   0,   0, -30, -30,
+	-50, -30, -30, -30, -30, -30, -30, -50 };
+
+constexpr short pawn_eg[64]{//advanced pawns are worth more, passed pawns get more on top in evaluate_pawns
+	  0,   0,   0,   0,   0,   0,   0,   0,
+	 40,  40,  40,  40,  40,  40,  40,  40,
+	 25,  25,  25,  25,  25,  25,  25,  25,
+	 15,  15,  15,  15,  15,  15,  15,  15,
+	  8,   8,   8,   8,   8,   8,   8,   8,
+	  3,   3,   3,   3,   3,   3,   3,   3,
+	  0,   0,   0,   0,   0,   0,   0,   0,
+	  0,   0,   0,   0,   0,   0,   0,   0 };
+
+struct Psq_weights {
+	short mg[2][7][64]; //[color][piece_type][square], material included, negative for black
+	short eg[2][7][64];
+};
 
-	virtual piece_types type() {
-		return KING;
+constexpr Psq_weights psq_weights(game_types variant) {//one weight set per variant, built by the compiler
+	Psq_weights weights{};
+	for (auto type = static_cast<int>(KING); type <= PAWN; ++type) {
+		for (auto square = 0; square < 64; ++square) {
+			int row = 7 - square / 8, file = square % 8; //row of the tables above
+			short mg = material_mg[type] + psq_mg[type][row * 8 + file];
+			short eg = material_eg[type] + (type == KING ? king_eg[row * 8 + file] : type == PAWN ? pawn_eg[row * 8 + file] : psq_mg[type][row * 8 + file]);
+			if (variant == game_types::KING_OF_THE_HILL && type == KING) {//reaching d4, e4, d5 or e5 wins, so the king is drawn to the centre all game long
+				int distance = std::max(std::max(3 - file, file - 4), std::max(3 - row, row - 4));
+				mg += 60 - 20 * distance;
+				eg += 120 - 40 * distance;
+			}
+			weights.mg[WHITE][type][square] = mg;
+			weights.eg[WHITE][type][square] = eg;
+			weights.mg[BLACK][type][square ^ 56] = -mg;
+			weights.eg[BLACK][type][square ^ 56] = -eg;
+		}
 	}
+	return weights;
+}
+
+constexpr Psq_weights variant_weights[6]{
+	psq_weights(game_types::CLASSIC),
+	psq_weights(game_types::CHESS_960),
+	psq_weights(game_types::HELLISH_ACCELERATION),
+	psq_weights(game_types::CRAZYHOUSE),
+	psq_weights(game_types::CHESS_EX),
+	psq_weights(game_types::KING_OF_THE_HILL),
 };
 
-class knight :public piece {
+class Board {
 public:
 
-	knight(bool color, short new_file, short new_rank, bool was_promoted = false) {
-		position.file = new_file;
-		position.rank = new_rank;
-		this->color = color;
-		this->promoted = was_promoted;
-	};
+	bitboard pieces[2][7]; //[color][piece_type], EMPTY is not used
 
-	virtual void find(bool mark) {
-		if (mark) {
-			auto i = position.file - 1;
-			auto j = position.rank - 2;
-			if (i >= 0 && j >= 0) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) checking_pieces.add(i, j, KNIGHT);
-					}
-					else board[i][j].attack();
-				}
-			}
+	bitboard occupancy[2];
 
-			i = position.file + 1;
-			j = position.rank - 2;
-			if (i < 8 && j >= 0) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) checking_pieces.add(i, j, KNIGHT);
-					}
-					else board[i][j].attack();
-				}
-			}
+	bitboard promoted;
 
-			i = position.file + 1;
-			j = position.rank + 2;
-			if (i < 8 && j < 8) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) checking_pieces.add(i, j, KNIGHT);
-					}
-					else board[i][j].attack();
-				}
-			}
+	unsigned char mailbox[64]; //piece_types by square, for lookups by square
 
-			i = position.file - 1;
-			j = position.rank + 2;
-			if (i >= 0 && j < 8) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) checking_pieces.add(i, j, KNIGHT);
-					}
-					else board[i][j].attack();
-				}
-			}
+	bitboard attacks_from[64]; //attacks of the piece on each square
 
-			i = position.file - 2;
-			j = position.rank - 1;
-			if (i >= 0 && j >= 0) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) checking_pieces.add(i, j, KNIGHT);
-					}
-					else board[i][j].attack();
-				}
-			}
+	unsigned char attack_count[2][64]; //how many pieces of each color attack each square
 
-			i = position.file + 2;
-			j = position.rank - 1;
-			if (i < 8 && j >= 0) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) checking_pieces.add(i, j, KNIGHT);
-					}
-					else board[i][j].attack();
-				}
-			}
+	bitboard attacked_by[2]; //squares with a non-zero attack_count, kept up to date by put_piece and remove_piece
 
-			i = position.file + 2;
-			j = position.rank + 1;
-			if (i < 8 && j < 8) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) checking_pieces.add(i, j, KNIGHT);
-					}
-					else board[i][j].attack();
-				}
-			}
+	bool player_to_move;
 
-			i = position.file - 2;
-			j = position.rank + 1;
-			if (i >= 0 && j < 8) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) checking_pieces.add(i, j, KNIGHT);
-					}
-					else board[i][j].attack();
-				}
-			}
-		}
-		else {
-			auto i = position.file - 1;
-			auto j = position.rank - 2;
-			if (i >= 0 && j >= 0) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						moves.add(i, j, CAPTURE);
-					}
-				}
-			}
+	bool castle[4]; //white kingside, white queenside, black kingside, black queenside
 
-			i = position.file + 1;
-			j = position.rank - 2;
-			if (i < 8 && j >= 0) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						moves.add(i, j, CAPTURE);
-					}
-				}
-			}
+	short castle_rook_file[4];
 
-			i = position.file + 1;
-			j = position.rank + 2;
-			if (i < 8 && j < 8) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						moves.add(i, j, CAPTURE);
-					}
-				}
-			}
+	bool en_passant;
 
-			i = position.file - 1;
-			j = position.rank + 2;
-			if (i >= 0 && j < 8) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						moves.add(i, j, CAPTURE);
-					}
-				}
-			}
+	Position en_passant_position;
 
-			i = position.file - 2;
-			j = position.rank - 1;
-			if (i >= 0 && j >= 0) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						moves.add(i, j, CAPTURE);
-					}
-				}
-			}
+	unsigned short halfmove_clock;
 
-			i = position.file + 2;
-			j = position.rank - 1;
-			if (i < 8 && j >= 0) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						moves.add(i, j, CAPTURE);
-					}
-				}
-			}
+	unsigned short fullmove_number;
 
-			i = position.file + 2;
-			j = position.rank + 1;
-			if (i < 8 && j < 8) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						moves.add(i, j, CAPTURE);
-					}
-				}
-			}
+	Undo undo_stack[MAX_UNDO]; //used as a ring: only the last MAX_UNDO moves can be taken back
 
-			i = position.file - 2;
-			j = position.rank + 1;
-			if (i >= 0 && j < 8) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-				}
-				else {
-					if (board[i][j].color() != get_color()) {
-						moves.add(i, j, CAPTURE);
-					}
-				}
-			}
+	unsigned int undo_cnt;
+
+	std::uint64_t key; //Zobrist key, updated incrementally
+
+	std::uint64_t pawn_key; //Zobrist key of the pawns alone, for the pawn hash table
+
+	unsigned char piece_count[2][7]; //[color][piece_type], updated incrementally
+
+	game_types variant; //picks the evaluation weights, kept by clear()
+
+	int psq_mg; //material and piece-square sums from white's point of view, updated incrementally
+
+	int psq_eg;
+
+	int phase; //MAX_PHASE with all pieces on the board, more after promotions
+
+	Board() : variant(game_types::CLASSIC) {
+		clear();
+	}
+
+	void clear() {
+		memset(pieces, 0, sizeof(pieces));
+		occupancy[WHITE] = occupancy[BLACK] = 0;
+		promoted = 0;
+		memset(mailbox, EMPTY, sizeof(mailbox));
+		memset(attacks_from, 0, sizeof(attacks_from));
+		memset(attack_count, 0, sizeof(attack_count));
+		memset(piece_count, 0, sizeof(piece_count));
+		psq_mg = psq_eg = phase = 0;
+		attacked_by[WHITE] = attacked_by[BLACK] = 0;
+		player_to_move = WHITE;
+		for (auto i = 0; i < 4; ++i) {
+			castle[i] = true;
+			castle_rook_file[i] = i % 2 ? 0 : 7;
 		}
+		en_passant = false;
+		en_passant_position = Position(-1, -1);
+		halfmove_clock = 0;
+		fullmove_number = 1;
+		undo_cnt = 0;
+		key = zobrist.castle[0] ^ zobrist.castle[1] ^ zobrist.castle[2] ^ zobrist.castle[3];
+		pawn_key = 0;
 	}
 
-	virtual piece_types type() {
-		return KNIGHT;
+	bitboard occupied_squares() const {
+		return occupancy[WHITE] | occupancy[BLACK];
 	}
-};
 
-class bishop :public piece {
-public:
+	bool occupied(int file, int rank) const {
+		return mailbox[rank * 8 + file] != EMPTY;
+	}
 
-	bishop(bool color, short new_file, short new_rank, bool was_promoted = false) {
-		position.file = new_file;
-		position.rank = new_rank;
-		this->color = color;
-		this->promoted = was_promoted;
-	};
+	bool color(int file, int rank) const {
+		return (occupancy[BLACK] & square_bb(file, rank)) != 0;
+	}
 
-	virtual void find(bool mark) {
-		if (mark) {
-			auto j = position.rank + 1;
-			auto i = position.file + 1;
-			for (; i < 8 && j < 8; ++i, ++j) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) {
-						board[i][j].attack();
-						break;
-					}
-					else {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) {
-							checking_pieces.add(i, j, BISHOP);
-							if (i != 7 && j != 7) board[i + 1][j + 1].attack();
-						}
-						break;
-					}
-				}
-			}
+	piece_types piece_type(int file, int rank) const {
+		return static_cast<piece_types>(mailbox[rank * 8 + file]);
+	}
 
-			j = position.rank - 1;
-			i = position.file + 1;
-			for (; i < 8 && j >= 0; ++i, --j) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) {
-						board[i][j].attack();
-						break;
-					}
-					else {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) {
-							checking_pieces.add(i, j, BISHOP);
-							if (i != 7 && j != 0) board[i + 1][j - 1].attack();
-						}
-						break;
-					}
-				}
-			}
+	bitboard piece_attacks(bool color, piece_types type, int square, bitboard occupied) const {
+		switch (type) {
+		case KING:
+			return king_attacks[square];
+		case QUEEN:
+			return queen_attacks(square, occupied);
+		case ROOK:
+			return rook_attacks(square, occupied);
+		case BISHOP:
+			return bishop_attacks(square, occupied);
+		case KNIGHT:
+			return knight_attacks[square];
+		case PAWN:
+			return pawn_attacks[color][square];
+		default:
+			return 0;
+		}
+	}
 
-			j = position.rank + 1;
-			i = position.file - 1;
-			for (; i >= 0 && j < 8; --i, ++j) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) {
-						board[i][j].attack();
-						break;
-					}
-					else {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) {
-							checking_pieces.add(i, j, BISHOP);
-							if (i != 0 && j != 7) board[i - 1][j + 1].attack();
-						}
-						break;
-					}
-				}
-			}
+	bitboard attackers_to(int square, bitboard occupied) const {//pieces of both colors
+		bitboard bishops = pieces[WHITE][BISHOP] | pieces[BLACK][BISHOP] | pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN];
+		bitboard rooks = pieces[WHITE][ROOK] | pieces[BLACK][ROOK] | pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN];
+		return (pawn_attacks[BLACK][square] & pieces[WHITE][PAWN]) | (pawn_attacks[WHITE][square] & pieces[BLACK][PAWN]) |
+			(knight_attacks[square] & (pieces[WHITE][KNIGHT] | pieces[BLACK][KNIGHT])) |
+			(king_attacks[square] & (pieces[WHITE][KING] | pieces[BLACK][KING])) |
+			(bishop_attacks(square, occupied) & bishops) | (rook_attacks(square, occupied) & rooks);
+	}
 
-			j = position.rank - 1;
-			i = position.file - 1;
-			for (; i >= 0 && j >= 0; --i, --j) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) {
-						board[i][j].attack();
-						break;
-					}
-					else {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) {
-							checking_pieces.add(i, j, BISHOP);
-							if (i != 0 && j != 0) board[i - 1][j - 1].attack();
-						}
-						break;
-					}
-				}
-			}
+	void add_attacks(bool color, bitboard attacks) {
+		while (attacks) {
+			int square = pop_lsb(attacks);
+			if (attack_count[color][square]++ == 0) attacked_by[color] |= 1ULL << square;
 		}
-		else {
-			auto j = position.rank + 1;
-			auto i = position.file + 1;
-			for (; i < 8 && j < 8; ++i, ++j) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) break;
-					else {
-						moves.add(i, j, CAPTURE);
-						break;
-					}
-				}
-			}
+	}
 
-			j = position.rank - 1;
-			i = position.file + 1;
-			for (; i < 8 && j >= 0; ++i, --j) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) break;
-					else {
-						moves.add(i, j, CAPTURE);
-						break;
-					}
-				}
-			}
+	void remove_attacks(bool color, bitboard attacks) {
+		while (attacks) {
+			int square = pop_lsb(attacks);
+			if (--attack_count[color][square] == 0) attacked_by[color] &= ~(1ULL << square);
+		}
+	}
 
-			j = position.rank + 1;
-			i = position.file - 1;
-			for (; i >= 0 && j < 8; --i, ++j) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) break;
-					else {
-						moves.add(i, j, CAPTURE);
-						break;
-					}
-				}
-			}
+	void update_sliders(int square) {//rays of sliders that see a square change when the square is filled or emptied
+		bitboard occupied = occupied_squares();
+		bitboard bishops = pieces[WHITE][BISHOP] | pieces[BLACK][BISHOP] | pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN];
+		bitboard rooks = pieces[WHITE][ROOK] | pieces[BLACK][ROOK] | pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN];
+		bitboard sliders = (bishop_attacks(square, occupied) & bishops) | (rook_attacks(square, occupied) & rooks);
+		while (sliders) {
+			int slider = pop_lsb(sliders);
+			bool c = (occupancy[BLACK] >> slider) & 1;
+			bitboard attacks = piece_attacks(c, static_cast<piece_types>(mailbox[slider]), slider, occupied);
+			remove_attacks(c, attacks_from[slider] & ~attacks);
+			add_attacks(c, attacks & ~attacks_from[slider]);
+			attacks_from[slider] = attacks;
+		}
+	}
 
-			j = position.rank - 1;
-			i = position.file - 1;
-			for (; i >= 0 && j >= 0; --i, --j) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) break;
-					else {
-						moves.add(i, j, CAPTURE);
-						break;
-					}
-				}
-			}
+	void put_piece(bool color, piece_types type, int square, bool was_promoted = false) {
+		bitboard b = 1ULL << square;
+		pieces[color][type] |= b;
+		occupancy[color] |= b;
+		if (was_promoted) promoted |= b;
+		mailbox[square] = type;
+		key ^= zobrist.pieces[color][type][square];
+		if (type == PAWN) pawn_key ^= zobrist.pieces[color][PAWN][square];
+		++piece_count[color][type];
+		psq_mg += variant_weights[static_cast<int>(variant)].mg[color][type][square];
+		psq_eg += variant_weights[static_cast<int>(variant)].eg[color][type][square];
+		phase += phase_weights[type];
+		update_sliders(square);
+		attacks_from[square] = piece_attacks(color, type, square, occupied_squares());
+		add_attacks(color, attacks_from[square]);
+	}
+
+	void remove_piece(int square) {
+		bitboard b = 1ULL << square;
+		bool c = (occupancy[BLACK] & b) != 0;
+		remove_attacks(c, attacks_from[square]);
+		attacks_from[square] = 0;
+		key ^= zobrist.pieces[c][mailbox[square]][square];
+		if (mailbox[square] == PAWN) pawn_key ^= zobrist.pieces[c][PAWN][square];
+		--piece_count[c][mailbox[square]];
+		psq_mg -= variant_weights[static_cast<int>(variant)].mg[c][mailbox[square]][square];
+		psq_eg -= variant_weights[static_cast<int>(variant)].eg[c][mailbox[square]][square];
+		phase -= phase_weights[mailbox[square]];
+		pieces[c][mailbox[square]] &= ~b;
+		occupancy[c] &= ~b;
+		promoted &= ~b;
+		mailbox[square] = EMPTY;
+		update_sliders(square);
+	}
+
+	void move_piece(int source, int destination) {
+		bool c = (occupancy[BLACK] >> source) & 1;
+		piece_types type = static_cast<piece_types>(mailbox[source]);
+		bool was_promoted = (promoted >> source) & 1;
+		remove_piece(source);
+		put_piece(c, type, destination, was_promoted);
+	}
+
+	void set_variant(game_types type) {//the sums are recomputed with the new weights
+		variant = type;
+		psq_mg = psq_eg = 0;
+		for (auto square = 0; square < 64; ++square) {
+			if (mailbox[square] == EMPTY) continue;
+			bool c = (occupancy[BLACK] >> square) & 1;
+			psq_mg += variant_weights[static_cast<int>(variant)].mg[c][mailbox[square]][square];
+			psq_eg += variant_weights[static_cast<int>(variant)].eg[c][mailbox[square]][square];
+		}
+	}
+
+	int repetitions() const {//how many times the current position has occurred, looking back only to the last irreversible move
+		int count = 1;
+		for (unsigned int distance = 4; distance <= halfmove_clock && distance <= undo_cnt && distance <= MAX_UNDO; distance += 2) {
+			if (undo_stack[(undo_cnt - distance) % MAX_UNDO].key == key) ++count;
 		}
+		return count;
 	}
 
-	virtual piece_types type() {
-		return BISHOP;
+	bool insufficient_material() const {//no sequence of legal moves can lead to checkmate
+		const bitboard dark_squares = 0xAA55AA55AA55AA55ULL;
+		for (auto c = 0; c < 2; ++c) {
+			if (piece_count[c][PAWN] || piece_count[c][ROOK] || piece_count[c][QUEEN]) return false;
+		}
+		int knights = piece_count[WHITE][KNIGHT] + piece_count[BLACK][KNIGHT];
+		int bishops = piece_count[WHITE][BISHOP] + piece_count[BLACK][BISHOP];
+		if (knights + bishops <= 1) return true;
+		if (knights) return false;
+		bitboard all_bishops = pieces[WHITE][BISHOP] | pieces[BLACK][BISHOP];
+		return !(all_bishops & dark_squares) || !(all_bishops & ~dark_squares); //bishops that all stand on one colour
 	}
 };
 
-class rook :public piece {
+class Game_state {//one game: position, result and rules; a value type, so any number of games can run side by side
 public:
 
-	rook(bool color, short new_file, short new_rank, bool was_promoted = false) {
-		position.file = new_file;
-		position.rank = new_rank;
-		this->color = color;
-		this->promoted = was_promoted;
-	};
-
-	virtual void find(bool mark) {
-		if (mark) {
-			for (auto i = position.rank + 1; i < 8; ++i) {
-				if (!board[position.file][i].occupied()) {
-					board[position.file][i].attack();
-					continue;
-				}
-				else {
-					if (board[position.file][i].color() == get_color()) {
-						board[position.file][i].attack();
-						break;
-					}
-					else {
-						board[position.file][i].attack();
-						if (board[position.file][i].piece_type() == KING) {
-							checking_pieces.add(position.file, i, ROOK);
-							if (i != 7) board[position.file][i + 1].attack();
-						}
-						break;
-					}
-				}
-			}
+	Board board;
 
-			for (auto i = position.rank - 1; i >= 0; --i) {
-				if (!board[position.file][i].occupied()) {
-					board[position.file][i].attack();
-					continue;
-				}
-				else {
-					if (board[position.file][i].color() == get_color()) {
-						board[position.file][i].attack();
-						break;
-					}
-					else {
-						board[position.file][i].attack();
-						if (board[position.file][i].piece_type() == KING) {
-							checking_pieces.add(position.file, i, ROOK);
-							if (i != 0) board[position.file][i - 1].attack();
-						}
-						break;
-					}
-				}
-			}
+	game_results game_result;
 
-			for (auto i = position.file + 1; i < 8; ++i) {
-				if (!board[i][position.rank].occupied()) {
-					board[i][position.rank].attack();
-					continue;
-				}
-				else {
-					if (board[i][position.rank].color() == get_color()) {
-						board[i][position.rank].attack();
-						break;
-					}
-					else {
-						board[i][position.rank].attack();
-						if (board[i][position.rank].piece_type() == KING) {
-							checking_pieces.add(i, position.rank, ROOK);
-							if (i != 7) board[i + 1][position.rank].attack();
-						}
-						break;
-					}
-				}
-			}
+	game_types game_type;
 
-			for (auto i = position.file - 1; i >= 0; --i) {
-				if (!board[i][position.rank].occupied()) {
-					board[i][position.rank].attack();
-					continue;
-				}
-				else {
-					if (board[i][position.rank].color() == get_color()) {
-						board[i][position.rank].attack();
-						break;
-					}
-					else {
-						board[i][position.rank].attack();
-						if (board[i][position.rank].piece_type() == KING) {
-							checking_pieces.add(i, position.rank, ROOK);
-							if (i != 0) board[i - 1][position.rank].attack();
-						}
-						break;
-					}
-				}
-			}
-		}
-		else {
-			for (auto i = position.rank + 1; i < 8; ++i) {
-				if (!board[position.file][i].occupied()) {
-					moves.add(position.file, i, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[position.file][i].color() == get_color()) break;
-					else {
-						moves.add(position.file, i, CAPTURE);
-						break;
-					}
-				}
-			}
+	char start_fen[MAX_FEN_LENGTH];
 
-			for (auto i = position.rank - 1; i >= 0; --i) {
-				if (!board[position.file][i].occupied()) {
-					moves.add(position.file, i, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[position.file][i].color() == get_color()) break;
-					else {
-						moves.add(position.file, i, CAPTURE);
-						break;
-					}
-				}
-			}
+	std::vector<Move> history; //every move played since start_fen
 
-			for (auto i = position.file + 1; i < 8; ++i) {
-				if (!board[i][position.rank].occupied()) {
-					moves.add(i, position.rank, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][position.rank].color() == get_color()) break;
-					else {
-						moves.add(i, position.rank, CAPTURE);
-						break;
-					}
-				}
-			}
+	explicit Game_state(game_types type = game_types::CLASSIC) : game_type(type), start_fen{} {
+		history.reserve(MAX_UNDO);
+	};
+};
 
-			for (auto i = position.file - 1; i >= 0; --i) {
-				if (!board[i][position.rank].occupied()) {
-					moves.add(i, position.rank, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][position.rank].color() == get_color()) break;
-					else {
-						moves.add(i, position.rank, CAPTURE);
-						break;
-					}
-				}
-			}
+std::uint64_t position_key(const Board& board) {//computed from scratch, board.key is kept equal to it by make_move
+	std::uint64_t key = 0;
+	for (auto color = 0; color < 2; ++color) {
+		for (auto type = static_cast<int>(KING); type <= PAWN; ++type) {
+			bitboard b = board.pieces[color][type];
+			while (b) key ^= zobrist.pieces[color][type][pop_lsb(b)];
 		}
 	}
-
-	virtual piece_types type() {
-		return ROOK;
+	for (auto i = 0; i < 4; ++i) {
+		if (board.castle[i]) key ^= zobrist.castle[i];
 	}
-};
+	if (board.en_passant) key ^= zobrist.en_passant[board.en_passant_position.file];
+	if (board.player_to_move) key ^= zobrist.side;
+	return key;
+}
 
-class queen :public piece {
+class Legality {//computed once per position, lets the generators emit only legal moves
 public:
 
-	queen(bool color, short new_file, short new_rank, bool was_promoted = false) {
-		position.file = new_file;
-		position.rank = new_rank;
-		this->color = color;
-		this->promoted = was_promoted;
-	};
+	int king_square;
 
-	virtual void find(bool mark) {
-		if (mark) {
-			for (auto i = position.rank + 1; i < 8; ++i) {
-				if (!board[position.file][i].occupied()) {
-					board[position.file][i].attack();
-					continue;
-				}
-				else {
-					if (board[position.file][i].color() == get_color()) {
-						board[position.file][i].attack();
-						break;
-					}
-					else {
-						board[position.file][i].attack();
-						if (board[position.file][i].piece_type() == KING) {
-							checking_pieces.add(position.file, i, QUEEN);
-							if (i != 7) board[position.file][i + 1].attack();
-						}
-						break;
-					}
-				}
-			}
+	bitboard checkers;
 
-			for (auto i = position.rank - 1; i >= 0; --i) {
-				if (!board[position.file][i].occupied()) {
-					board[position.file][i].attack();
-					continue;
-				}
-				else {
-					if (board[position.file][i].color() == get_color()) {
-						board[position.file][i].attack();
-						break;
-					}
-					else {
-						board[position.file][i].attack();
-						if (board[position.file][i].piece_type() == KING) {
-							checking_pieces.add(position.file, i, QUEEN);
-							if (i != 0) board[position.file][i - 1].attack();
-						}
-						break;
-					}
-				}
-			}
+	bitboard pinned;
 
-			for (auto i = position.file + 1; i < 8; ++i) {
-				if (!board[i][position.rank].occupied()) {
-					board[i][position.rank].attack();
-					continue;
-				}
-				else {
-					if (board[i][position.rank].color() == get_color()) {
-						board[i][position.rank].attack();
-						break;
-					}
-					else {
-						board[i][position.rank].attack();
-						if (board[i][position.rank].piece_type() == KING) {
-							checking_pieces.add(i, position.rank, QUEEN);
-							if (i != 7) board[i + 1][position.rank].attack();
-						}
-						break;
-					}
-				}
-			}
+	bitboard check_mask; //squares that capture the checker or block the check, all squares when not in check
 
-			for (auto i = position.file - 1; i >= 0; --i) {
-				if (!board[i][position.rank].occupied()) {
-					board[i][position.rank].attack();
-					continue;
-				}
-				else {
-					if (board[i][position.rank].color() == get_color()) {
-						board[i][position.rank].attack();
-						break;
-					}
-					else {
-						board[i][position.rank].attack();
-						if (board[i][position.rank].piece_type() == KING) {
-							checking_pieces.add(i, position.rank, QUEEN);
-							if (i != 0) board[i - 1][position.rank].attack();
-						}
-						break;
-					}
-				}
-			}
+	Legality() : king_square(0), checkers(0), pinned(0), check_mask(~0ULL) {};
+};
 
-			auto j = position.rank + 1;
-			auto i = position.file + 1;
-			for (; i < 8 && j < 8; ++i, ++j) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) {
-						board[i][j].attack();
-						break;
-					}
-					else {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) {
-							checking_pieces.add(i, j, QUEEN);
-							if (i != 7 && j != 7) board[i + 1][j + 1].attack();
-						}
-						break;
-					}
-				}
-			}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-			j = position.rank - 1;
-			i = position.file + 1;
-			for (; i < 8 && j >= 0; ++i, --j) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) {
-						board[i][j].attack();
-						break;
-					}
-					else {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) {
-							checking_pieces.add(i, j, QUEEN);
-							if (i != 7 && j != 0) board[i + 1][j - 1].attack();
-						}
-						break;
-					}
-				}
-			}
+bitboard legal_targets(const Legality& legality, int square) {
+	bitboard targets = legality.check_mask;
+	if (legality.pinned & (1ULL << square)) targets &= line_bb[legality.king_square][square];
+	return targets;
+}
 
-			j = position.rank + 1;
-			i = position.file - 1;
-			for (; i >= 0 && j < 8; --i, ++j) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) {
-						board[i][j].attack();
-						break;
-					}
-					else {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) {
-							checking_pieces.add(i, j, QUEEN);
-							if (i != 0 && j != 7) board[i - 1][j + 1].attack();
-						}
-						break;
-					}
-				}
-			}
+bool en_passant_legal(const Board& board, int source, int destination, int captured, bool color, int king_square) {//the only move that removes two pieces from one rank
+	bitboard occupied = (board.occupied_squares() ^ (1ULL << source) ^ (1ULL << captured)) | (1ULL << destination);
+	return !(board.attackers_to(king_square, occupied) & board.occupancy[!color] & ~(1ULL << captured));
+}
 
-			j = position.rank - 1;
-			i = position.file - 1;
-			for (; i >= 0 && j >= 0; --i, --j) {
-				if (!board[i][j].occupied()) {
-					board[i][j].attack();
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) {
-						board[i][j].attack();
-						break;
-					}
-					else {
-						board[i][j].attack();
-						if (board[i][j].piece_type() == KING) {
-							checking_pieces.add(i, j, QUEEN);
-							if (i != 0 && j != 0) board[i - 1][j - 1].attack();
-						}
-						break;
-					}
-				}
-			}
-		}
-		else {
-			for (auto i = position.rank + 1; i < 8; ++i) {
-				if (!board[position.file][i].occupied()) {
-					moves.add(position.file, i, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[position.file][i].color() == get_color()) break;
-					else {
-						moves.add(position.file, i, CAPTURE);
-						break;
-					}
-				}
-			}
+void add_moves(const Board& board, Move_list& moves, int source, bitboard targets) {
+	while (targets) {
+		int destination = pop_lsb(targets);
+		moves.add(Move(source, destination, board.mailbox[destination] ? CAPTURE : NO_CAPTURE));
+	}
+}
 
-			for (auto i = position.rank - 1; i >= 0; --i) {
-				if (!board[position.file][i].occupied()) {
-					moves.add(position.file, i, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[position.file][i].color() == get_color()) break;
-					else {
-						moves.add(position.file, i, CAPTURE);
-						break;
-					}
-				}
-			}
+void add_pawn_moves(Move_list& moves, bitboard targets, int shift, move_types type) {//source = destination - shift
+	while (targets) {
+		int destination = pop_lsb(targets);
+		moves.add(Move(destination - shift, destination, type));
+	}
+}
 
-			for (auto i = position.file + 1; i < 8; ++i) {
-				if (!board[i][position.rank].occupied()) {
-					moves.add(i, position.rank, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][position.rank].color() == get_color()) break;
-					else {
-						moves.add(i, position.rank, CAPTURE);
-						break;
-					}
-				}
-			}
+void add_promotions(Move_list& moves, bitboard targets, int shift, move_types type) {
+	while (targets) {
+		int destination = pop_lsb(targets);
+		for (auto promotion = QUEEN; promotion <= KNIGHT; promotion = static_cast<piece_types>(promotion + 1)) {
+			moves.add(Move(destination - shift, destination, type, promotion));
+		}
+	}
+}
 
-			for (auto i = position.file - 1; i >= 0; --i) {
-				if (!board[i][position.rank].occupied()) {
-					moves.add(i, position.rank, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][position.rank].color() == get_color()) break;
-					else {
-						moves.add(i, position.rank, CAPTURE);
-						break;
-					}
-				}
-			}
+inline bitboard shift_bb(bitboard b, int shift) {
+	return shift > 0 ? b << shift : b >> -shift;
+}
 
-			auto j = position.rank + 1;
-			auto i = position.file + 1;
-			for (; i < 8 && j < 8; ++i, ++j) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) break;
-					else {
-						moves.add(i, j, CAPTURE);
-						break;
-					}
-				}
-			}
+enum generation_types {
+	ALL_MOVES,
+	TACTICAL_MOVES, //captures, en passant and promotions
+	QUIET_MOVES, //everything else, castling included
+};
 
-			j = position.rank - 1;
-			i = position.file + 1;
-			for (; i < 8 && j >= 0; ++i, --j) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) break;
-					else {
-						moves.add(i, j, CAPTURE);
-						break;
-					}
-				}
-			}
+void pawn_moves(const Board& board, bitboard pawns, bitboard targets, bool color, Move_list& moves, generation_types type) {//all pawns in pawns share the same target mask
+	const bitboard not_a_file = ~0x0101010101010101ULL, not_h_file = ~0x8080808080808080ULL;
+	int forward = color ? -8 : 8;
+	bitboard last_rank = color ? 0xFFULL : 0xFFULL << 56;
+	bitboard third_rank = color ? 0xFFULL << 40 : 0xFFULL << 16;
+	bitboard empty = ~board.occupied_squares();
+	bitboard enemy = board.occupancy[!color];
+
+	bitboard single = shift_bb(pawns, forward) & empty;
+	bitboard double_push = shift_bb(single & third_rank, forward) & empty & targets;
+	single &= targets;
+	bitboard left = shift_bb(pawns & not_a_file, forward - 1) & enemy & targets;
+	bitboard right = shift_bb(pawns & not_h_file, forward + 1) & enemy & targets;
+
+	if (type != QUIET_MOVES) {
+		add_pawn_moves(moves, left & ~last_rank, forward - 1, CAPTURE);
+		add_pawn_moves(moves, right & ~last_rank, forward + 1, CAPTURE);
+		add_promotions(moves, single & last_rank, forward, PROMOTION);
+		add_promotions(moves, left & last_rank, forward - 1, CAPTURE_WITH_PROMOTION);
+		add_promotions(moves, right & last_rank, forward + 1, CAPTURE_WITH_PROMOTION);
+	}
+	if (type != TACTICAL_MOVES) {
+		add_pawn_moves(moves, single & ~last_rank, forward, NO_CAPTURE);
+		add_pawn_moves(moves, double_push, 2 * forward, LONG_PAWN_MOVE);
+	}
+}
 
-			j = position.rank + 1;
-			i = position.file - 1;
-			for (; i >= 0 && j < 8; --i, ++j) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) break;
-					else {
-						moves.add(i, j, CAPTURE);
-						break;
-					}
-				}
-			}
+void en_passant_moves(const Board& board, bool color, const Legality& legality, Move_list& moves, bitboard sources) {
+	if (!board.en_passant) return;
+	int destination = board.en_passant_position.rank * 8 + board.en_passant_position.file;
+	int captured = color ? destination + 8 : destination - 8;
+	bitboard pawns = pawn_attacks[!color][destination] & board.pieces[color][PAWN] & sources;
+	while (pawns) {
+		int source = pop_lsb(pawns);
+		if (en_passant_legal(board, source, destination, captured, color, legality.king_square)) moves.add(Move(source, destination, EN_PASSANT));
+	}
+}
 
-			j = position.rank - 1;
-			i = position.file - 1;
-			for (; i >= 0 && j >= 0; --i, --j) {
-				if (!board[i][j].occupied()) {
-					moves.add(i, j, NO_CAPTURE);
-					continue;
-				}
-				else {
-					if (board[i][j].color() == get_color()) break;
-					else {
-						moves.add(i, j, CAPTURE);
-						break;
-					}
-				}
-			}
+void castling_moves(const Board& board, bool color, const Legality& legality, Move_list& moves) {
+	if (legality.checkers) return;
+	for (auto side = 0; side < 2; ++side) {
+		int index = color * 2 + side;
+		if (!board.castle[index]) continue;
+		int rank = color ? 7 : 0;
+		int king_from = legality.king_square;
+		int rook_from = rank * 8 + board.castle_rook_file[index];
+		int king_to = rank * 8 + (side ? 2 : 6);
+		int rook_to = rank * 8 + (side ? 3 : 5);
+		bitboard king_and_rook = (1ULL << king_from) | (1ULL << rook_from);
+		bitboard path = between_bb[king_from][king_to] | between_bb[rook_from][rook_to] | (1ULL << king_to) | (1ULL << rook_to);
+		if (path & board.occupied_squares() & ~king_and_rook) continue;
+		bitboard occupied = board.occupied_squares() ^ king_and_rook;
+		bitboard king_path = between_bb[king_from][king_to] | (1ULL << king_to);
+		bool safe = true;
+		while (king_path && safe) {
+			if (board.attackers_to(pop_lsb(king_path), occupied) & board.occupancy[!color]) safe = false;
 		}
+		if (safe) moves.add(Move(king_from, rook_from, CASTLES)); //the destination of castling is the rook's square
 	}
+}
+
+void generate_moves(const Board& board, const Legality& legality, Move_list& moves, generation_types type = ALL_MOVES, bitboard sources = ~0ULL) {//legal moves of the pieces on sources in one pass, piece type by piece type
+	bool us = board.player_to_move;
+	bitboard own = board.occupancy[us];
+	bitboard targets = type == TACTICAL_MOVES ? board.occupancy[!us] : type == QUIET_MOVES ? ~board.occupied_squares() : ~own; //pawns are handled by pawn_moves
 
-	virtual piece_types type() {
-		return QUEEN;
+	bitboard king_targets = sources & (1ULL << legality.king_square) ? king_attacks[legality.king_square] & targets : 0;
+	bitboard occupied = board.occupied_squares() ^ (1ULL << legality.king_square); //the king must not hide behind itself from a slider
+	bitboard safe = king_targets;
+	while (king_targets) {
+		int destination = pop_lsb(king_targets);
+		if (board.attackers_to(destination, occupied) & board.occupancy[!us]) safe &= ~(1ULL << destination);
 	}
-};
+	add_moves(board, moves, legality.king_square, safe);
+	if (!legality.check_mask) return; //double check
 
-class no_piece :public piece {
-public:
+	if (type != TACTICAL_MOVES && (sources & (1ULL << legality.king_square))) castling_moves(board, us, legality, moves);
 
-	no_piece(short new_file, short new_rank) {
-		position.file = new_file;
-		position.rank = new_rank;
-	};
+	bitboard pawns = board.pieces[us][PAWN] & sources;
+	pawn_moves(board, pawns & ~legality.pinned, legality.check_mask, us, moves, type);
+	bitboard pinned_pawns = pawns & legality.pinned;
+	while (pinned_pawns) {
+		int square = pop_lsb(pinned_pawns);
+		pawn_moves(board, 1ULL << square, legal_targets(legality, square), us, moves, type);
+	}
+	if (type != QUIET_MOVES) en_passant_moves(board, us, legality, moves, sources);
 
-	virtual piece_types type() {
-		return EMPTY;
+	bitboard knights = board.pieces[us][KNIGHT] & ~legality.pinned & sources; //a pinned knight can never move
+	while (knights) {
+		int square = pop_lsb(knights);
+		add_moves(board, moves, square, knight_attacks[square] & targets & legality.check_mask);
 	}
 
-	virtual void find(bool mark) {
-		throw "This square is empty";
+	bitboard sliders = (board.pieces[us][BISHOP] | board.pieces[us][ROOK] | board.pieces[us][QUEEN]) & sources;
+	while (sliders) {
+		int square = pop_lsb(sliders);
+		add_moves(board, moves, square, board.attacks_from[square] & targets & legal_targets(legality, square));
 	}
-};
+}
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1458,34 +1077,161 @@ public:
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void initialize_classic() {
-	for (auto i = 2; i < 6; ++i) {
-		for (auto j = 0; j < 8; ++j) {
-			board[j][i]._piece = new no_piece(j, i);
+const char piece_chars[] = " kqrbnp"; //by piece_types
+
+const char* read_number(const char* fen, unsigned int& number) {
+	if (*fen < '0' || *fen > '9') throw "Invalid FEN";
+	for (number = 0; *fen >= '0' && *fen <= '9'; ++fen) number = number * 10 + (*fen - '0');
+	return fen;
+}
+
+void set_castling_right(Board& board, bool color, char c) {//K/Q take the outermost rook on that side (X-FEN), A-H name the rook's file (Shredder-FEN)
+	int rank = color ? 7 : 0;
+	bitboard back_rank = 0xFFULL << (rank * 8);
+	bitboard king = board.pieces[color][KING] & back_rank;
+	bitboard rooks = board.pieces[color][ROOK] & back_rank;
+	if (!king) throw "Invalid FEN";
+	int king_square = lsb(king);
+	int rook_square;
+	if (c == 'K') {
+		rooks &= ~((king << 1) - 1);
+		if (!rooks) throw "Invalid FEN";
+		rook_square = msb(rooks);
+	}
+	else if (c == 'Q') {
+		rooks &= king - 1;
+		if (!rooks) throw "Invalid FEN";
+		rook_square = lsb(rooks);
+	}
+	else {
+		rook_square = rank * 8 + (c - 'A');
+		if (!(rooks & (1ULL << rook_square))) throw "Invalid FEN";
+	}
+	int index = color * 2 + (rook_square < king_square);
+	board.castle[index] = true;
+	board.castle_rook_file[index] = static_cast<short>(rook_square % 8);
+}
+
+void set_position(Board& board, const char* fen) {//pieces, side to move, castling (KQkq, X-FEN or Shredder-FEN), en passant and the clocks
+	board.clear();
+	int rank = 7, file = 0;
+	for (; *fen && *fen != ' '; ++fen) {
+		if (*fen == '/') {
+			if (file != 8 || rank == 0) throw "Invalid FEN";
+			--rank;
+			file = 0;
+		}
+		else if (*fen >= '1' && *fen <= '8') file += *fen - '0';
+		else {
+			const char* piece = *fen ? strchr(piece_chars + 1, *fen | 0x20) : nullptr;
+			if (!piece || file > 7) throw "Invalid FEN";
+			board.put_piece(*fen & 0x20 ? BLACK : WHITE, static_cast<piece_types>(piece - piece_chars), rank * 8 + file);
+			++file;
 		}
+		if (file > 8) throw "Invalid FEN";
 	}
-	for (auto i = 1; i < 8; i += 5) {
-		for (auto j = 0; j < 8; ++j) {
-			if (i == 1) board[j][i]._piece = new pawn(WHITE, j, i);
-			if (i == 6) board[j][i]._piece = new pawn(BLACK, j, i);
-		}
-	}
-	board[0][0]._piece = new rook(WHITE, 0, 0);
-	board[1][0]._piece = new knight(WHITE, 1, 0);
-	board[2][0]._piece = new bishop(WHITE, 2, 0);
-	board[3][0]._piece = new queen(WHITE, 3, 0);
-	board[4][0]._piece = new king(WHITE, 4, 0);
-	board[5][0]._piece = new bishop(WHITE, 5, 0);
-	board[6][0]._piece = new knight(WHITE, 6, 0);
-	board[7][0]._piece = new rook(WHITE, 7, 0);
-	board[0][7]._piece = new rook(BLACK, 0, 7);
-	board[1][7]._piece = new knight(BLACK, 1, 7);
-	board[2][7]._piece = new bishop(BLACK, 2, 7);
-	board[3][7]._piece = new queen(BLACK, 3, 7);
-	board[4][7]._piece = new king(BLACK, 4, 7);
-	board[5][7]._piece = new bishop(BLACK, 5, 7);
-	board[6][7]._piece = new knight(BLACK, 6, 7);
-	board[7][7]._piece = new rook(BLACK, 7, 7);
+	if (rank || file != 8 || board.piece_count[WHITE][KING] != 1 || board.piece_count[BLACK][KING] != 1) throw "Invalid FEN";
+	if ((board.pieces[WHITE][PAWN] | board.pieces[BLACK][PAWN]) & 0xFF000000000000FFULL) throw "Invalid FEN"; //pawns on the first or last rank
+
+	while (*fen == ' ') ++fen;
+	if (*fen != 'w' && *fen != 'b') throw "Invalid FEN";
+	board.player_to_move = *fen++ == 'b' ? BLACK : WHITE;
+	bool stm = board.player_to_move;
+	if (board.attackers_to(lsb(board.pieces[!stm][KING]), board.occupied_squares()) & board.occupancy[stm]) throw "Invalid FEN"; //the king could be taken
+
+	for (auto i = 0; i < 4; ++i) board.castle[i] = false;
+	while (*fen == ' ') ++fen;
+	if (*fen == '-') ++fen;
+	else {
+		for (; *fen && *fen != ' '; ++fen) {
+			char c = *fen & ~0x20;
+			if (c != 'K' && c != 'Q' && (c < 'A' || c > 'H')) throw "Invalid FEN";
+			set_castling_right(board, (*fen & 0x20) != 0, c);
+		}
+	}
+
+	while (*fen == ' ') ++fen;
+	board.en_passant = false;
+	if (*fen == '-') ++fen;
+	else if (*fen) {
+		if (fen[0] < 'a' || fen[0] > 'h' || fen[1] != (board.player_to_move ? '3' : '6')) throw "Invalid FEN";
+		board.en_passant = true;
+		board.en_passant_position = Position(static_cast<short>(fen[0] - 'a'), static_cast<short>(fen[1] - '1'));
+		int pushed_pawn = (fen[1] - '1') * 8 + fen[0] - 'a' + (board.player_to_move ? 8 : -8);
+		if (!(board.pieces[!board.player_to_move][PAWN] & (1ULL << pushed_pawn))) throw "Invalid FEN"; //no pawn could have just made the double step
+		fen += 2;
+	}
+
+	unsigned int halfmove_clock = 0, fullmove_number = 1; //both clocks are optional, as in EPD
+	while (*fen == ' ') ++fen;
+	if (*fen) fen = read_number(fen, halfmove_clock);
+	while (*fen == ' ') ++fen;
+	if (*fen) fen = read_number(fen, fullmove_number);
+	board.halfmove_clock = static_cast<unsigned short>(halfmove_clock);
+	board.fullmove_number = static_cast<unsigned short>(fullmove_number ? fullmove_number : 1);
+	board.undo_cnt = 0;
+	board.key = position_key(board);
+}
+
+char* write_number(char* out, unsigned int number) {
+	char digits[10];
+	int cnt = 0;
+	do {
+		digits[cnt++] = static_cast<char>('0' + number % 10);
+		number /= 10;
+	} while (number);
+	while (cnt) *out++ = digits[--cnt];
+	return out;
+}
+
+char* write_fen(const Board& board, char* out) {//writes at most MAX_FEN_LENGTH characters including the terminating zero, returns the end
+	for (auto rank = 7; rank >= 0; --rank) {
+		int empty = 0;
+		for (auto file = 0; file < 8; ++file) {
+			int square = rank * 8 + file;
+			if (board.mailbox[square] == EMPTY) {
+				++empty;
+				continue;
+			}
+			if (empty) *out++ = static_cast<char>('0' + empty);
+			empty = 0;
+			char piece = piece_chars[board.mailbox[square]];
+			*out++ = (board.occupancy[BLACK] >> square) & 1 ? piece : static_cast<char>(piece & ~0x20);
+		}
+		if (empty) *out++ = static_cast<char>('0' + empty);
+		if (rank) *out++ = '/';
+	}
+	*out++ = ' ';
+	*out++ = board.player_to_move ? 'b' : 'w';
+	*out++ = ' ';
+	char* castling = out;
+	for (auto index = 0; index < 4; ++index) {
+		if (!board.castle[index]) continue;
+		bool color = index >= 2;
+		int rank = color ? 7 : 0;
+		bitboard rooks = board.pieces[color][ROOK] & (0xFFULL << (rank * 8));
+		int rook_square = rank * 8 + board.castle_rook_file[index];
+		bool outermost = index % 2 ? lsb(rooks) == rook_square : msb(rooks) == rook_square;
+		char c = outermost ? (index % 2 ? 'Q' : 'K') : static_cast<char>('A' + board.castle_rook_file[index]); //Shredder letter only where K/Q would be ambiguous
+		*out++ = color ? static_cast<char>(c | 0x20) : c;
+	}
+	if (out == castling) *out++ = '-';
+	*out++ = ' ';
+	if (board.en_passant) {
+		*out++ = static_cast<char>('a' + board.en_passant_position.file);
+		*out++ = static_cast<char>('1' + board.en_passant_position.rank);
+	}
+	else *out++ = '-';
+	*out++ = ' ';
+	out = write_number(out, board.halfmove_clock);
+	*out++ = ' ';
+	out = write_number(out, board.fullmove_number);
+	*out = '\0';
+	return out;
+}
+
+void initialize_classic(Board& board) {
+	set_position(board, FEN);
 }
 
 void get_960_position(std::string& starting_position) {
@@ -1543,36 +1289,34 @@ void get_960_position(std::string& starting_position) {
 	available_positions.erase(iter);
 }
 
-void initialize_960() {
-	for (auto i = 2; i < 6; ++i) {
-		for (auto j = 0; j < 8; ++j) {
-			board[j][i]._piece = new no_piece(j, i);
-		}
-	}
+void initialize_960(Board& board) {
+	board.clear();
 	for (auto i = 1; i < 8; i += 5) {
 		for (auto j = 0; j < 8; ++j) {
-			if (i == 1) board[j][i]._piece = new pawn(WHITE, j, i);
-			if (i == 6) board[j][i]._piece = new pawn(BLACK, j, i);
+			if (i == 1) board.put_piece(WHITE, PAWN, i * 8 + j);
+			if (i == 6) board.put_piece(BLACK, PAWN, i * 8 + j);
 		}
 	}
 	std::string starting_position{ "RNBQKBNR" };
 	get_960_position(starting_position);
+	board.castle_rook_file[0] = board.castle_rook_file[2] = static_cast<short>(starting_position.find_last_of('R'));
+	board.castle_rook_file[1] = board.castle_rook_file[3] = static_cast<short>(starting_position.find_first_of('R'));
 	for (auto i = 0; i < 8; ++i) {
 		switch (starting_position[i]) {
 		case 'K':
-			board[i][0]._piece = new king(WHITE, i, 0);
+			board.put_piece(WHITE, KING, i);
 			break;
 		case 'Q':
-			board[i][0]._piece = new queen(WHITE, i, 0);
+			board.put_piece(WHITE, QUEEN, i);
 			break;
 		case 'R':
-			board[i][0]._piece = new rook(WHITE, i, 0);
+			board.put_piece(WHITE, ROOK, i);
 			break;
 		case 'B':
-			board[i][0]._piece = new bishop(WHITE, i, 0);
+			board.put_piece(WHITE, BISHOP, i);
 			break;
 		case 'N':
-			board[i][0]._piece = new knight(WHITE, i, 0);
+			board.put_piece(WHITE, KNIGHT, i);
 			break;
 		default:
 			throw "Board initialization error";
@@ -1582,19 +1326,19 @@ void initialize_960() {
 	for (auto i = 0; i < 8; ++i) {
 		switch (starting_position[i]) {
 		case 'K':
-			board[i][7]._piece = new king(BLACK, i, 7);
+			board.put_piece(BLACK, KING, 56 + i);
 			break;
 		case 'Q':
-			board[i][7]._piece = new queen(BLACK, i, 7);
+			board.put_piece(BLACK, QUEEN, 56 + i);
 			break;
 		case 'R':
-			board[i][7]._piece = new rook(BLACK, i, 7);
+			board.put_piece(BLACK, ROOK, 56 + i);
 			break;
 		case 'B':
-			board[i][7]._piece = new bishop(BLACK, i, 7);
+			board.put_piece(BLACK, BISHOP, 56 + i);
 			break;
 		case 'N':
-			board[i][7]._piece = new knight(BLACK, i, 7);
+			board.put_piece(BLACK, KNIGHT, 56 + i);
 			break;
 		default:
 			throw "Board initialization error";
@@ -1603,70 +1347,66 @@ void initialize_960() {
 	}
 }
 
-void initialize_board() {
-	switch (game_type) {
+void initialize_board(Game_state& game) {
+	Board& board = game.board;
+	board.set_variant(game.game_type);
+	switch (game.game_type) {
 	case game_types::CLASSIC:
-		initialize_classic();
+		initialize_classic(board);
 		break;
 	case game_types::CHESS_960:
-		initialize_960();
+		initialize_960(board);
 		break;
 	case game_types::HELLISH_ACCELERATION:
-		initialize_classic();
+		initialize_classic(board);
 		break;
 	case game_types::CRAZYHOUSE:
-		initialize_classic();
+		initialize_classic(board);
 		break;
 	case game_types::CHESS_EX:
-		initialize_classic();
+		initialize_classic(board);
 		break;
 	case game_types::KING_OF_THE_HILL:
-		initialize_classic();
+		initialize_classic(board);
 		break;
 	default:
 		throw "Board initialization error";
 		break;
 	}
+	write_fen(board, game.start_fen);
+	game.history.clear();
 }
 
-void delete_board() {
-	for (auto i = 0; i < 8; ++i) {
-		for (auto j = 0; j < 8; ++j) {
-			delete board[j][i]._piece;
-		}
-	}
-}
-
-void print_board() {
+void print_board(const Board& board) {
 	for (auto i = 7; i >= 0; --i) {
 		for (auto j = 0; j < 8; ++j) {
-			piece_types piece_type = board[j][i].piece_type();
+			piece_types piece_type = board.piece_type(j, i);
 			switch (piece_type) {
 			case EMPTY:
 				std::cout << '_';
 				break;
 			case KING:
-				if (!board[j][i].color()) std::cout << 'K';
+				if (!board.color(j, i)) std::cout << 'K';
 				else std::cout << 'k';
 				break;
 			case QUEEN:
-				if (!board[j][i].color()) std::cout << 'Q';
+				if (!board.color(j, i)) std::cout << 'Q';
 				else std::cout << 'q';
 				break;
 			case ROOK:
-				if (!board[j][i].color()) std::cout << 'R';
+				if (!board.color(j, i)) std::cout << 'R';
 				else std::cout << 'r';
 				break;
 			case BISHOP:
-				if (!board[j][i].color()) std::cout << 'B';
+				if (!board.color(j, i)) std::cout << 'B';
 				else std::cout << 'b';
 				break;
 			case KNIGHT:
-				if (!board[j][i].color()) std::cout << 'N';
+				if (!board.color(j, i)) std::cout << 'N';
 				else std::cout << 'n';
 				break;
 			case PAWN:
-				if (!board[j][i].color()) std::cout << 'P';
+				if (!board.color(j, i)) std::cout << 'P';
 				else std::cout << 'p';
 				break;
 			}
@@ -1674,122 +1414,145 @@ void print_board() {
 		}
 		std::cout << std::endl;
 	}
+	char fen[MAX_FEN_LENGTH];
+	write_fen(board, fen);
+	std::cout << fen << std::endl;
 }
 
-void mark_attacked() {
-	for (auto i = 0; i < 8; ++i) {
-		for (auto j = 0; j < 8; ++j) {
-			if (board[i][j].occupied() && (board[i][j].color() != player_to_move)) board[i][j]._piece->find(true);
-		}
-	}
+bool check_king(const Board& board) {//returns false if king is under check
+	return !(board.attacked_by[!board.player_to_move] & board.pieces[board.player_to_move][KING]);
 }
 
-void unmark_attacked() {
-	for (auto i = 0; i < 8; ++i) {
-		for (auto j = 0; j < 8; ++j) {
-			board[i][j].unattack();
-		}
-	}
+Legality compute_legality(const Board& board) {
+	Legality legality;
+	bool us = board.player_to_move;
+	bitboard occupied = board.occupied_squares();
+	legality.king_square = lsb(board.pieces[us][KING]);
+	legality.checkers = board.attackers_to(legality.king_square, occupied) & board.occupancy[!us];
+	if (legality.checkers & (legality.checkers - 1)) legality.check_mask = 0; //only the king can answer a double check
+	else if (legality.checkers) legality.check_mask = legality.checkers | between_bb[legality.king_square][lsb(legality.checkers)];
+	bitboard snipers = (rook_attacks(legality.king_square, 0) & (board.pieces[!us][ROOK] | board.pieces[!us][QUEEN])) |
+		(bishop_attacks(legality.king_square, 0) & (board.pieces[!us][BISHOP] | board.pieces[!us][QUEEN]));
+	while (snipers) {
+		bitboard blockers = between_bb[legality.king_square][pop_lsb(snipers)] & occupied;
+		if (blockers && !(blockers & (blockers - 1)) && (blockers & board.occupancy[us])) legality.pinned |= blockers;
+	}
+	return legality;
 }
 
-Position find_king() {
-	for (auto i = 0; i < 8; ++i) {
-		for (auto j = 0; j < 8; ++j) {
-			if (board[i][j].occupied() && (board[i][j].color() == player_to_move) && board[i][j].piece_type() == KING) {
-				return Position(i, j);
-			}
-		}
+void update_castling_rights(Board& board, Position source, Position destination) {
+	for (auto i = 0; i < 4; ++i) {
+		Position rook(board.castle_rook_file[i], i < 2 ? 0 : 7);
+		if (source == rook || destination == rook) board.castle[i] = false;
 	}
-	std::cout << "Error: there is no king on board" << std::endl;
-	return Position(-1, -1);
-}
-
-bool check_king() {//returns false if king is under check
-	bool res;
-	checking_pieces.clear();
-	Position king_position = find_king();
-	mark_attacked();
-	board[king_position.file][king_position.rank].is_attacked() ? res = false : res = true;
-	unmark_attacked();
-	return res;
+	if (board.piece_type(source.file, source.rank) == KING) board.castle[board.player_to_move * 2] = board.castle[board.player_to_move * 2 + 1] = false;
 }
 
-bool no_capture_move(Position source, Position destination) {
-	board[destination.file][destination.rank]._piece = board[source.file][source.rank]._piece;
-	board[source.file][source.rank]._piece = new no_piece(source.file, source.rank);
-	if (!check_king()) {
-		std::cout << "Error: your king is in check after the move" << std::endl;
-		board[source.file][source.rank]._piece = board[destination.file][destination.rank]._piece;
-		board[destination.file][destination.rank]._piece = new no_piece(source.file, source.rank);
-		return false;
+void make_move(Board& board, Move move) {
+	Undo& undo = board.undo_stack[board.undo_cnt++ % MAX_UNDO];
+	int source = move.source(), destination = move.destination();
+	move_types type = move.move_type();
+	undo.move = move;
+	undo.captured = EMPTY;
+	undo.captured_promoted = false;
+	memcpy(undo.castle, board.castle, sizeof(board.castle));
+	undo.en_passant = board.en_passant;
+	undo.en_passant_position = board.en_passant_position;
+	undo.halfmove_clock = board.halfmove_clock;
+	undo.key = board.key;
+
+	if (board.mailbox[source] == PAWN) board.halfmove_clock = 0;
+	else ++board.halfmove_clock;
+	update_castling_rights(board, square_position(source), square_position(destination));
+	for (auto i = 0; i < 4; ++i) {
+		if (board.castle[i] != undo.castle[i]) board.key ^= zobrist.castle[i];
+	}
+	if (board.en_passant) board.key ^= zobrist.en_passant[board.en_passant_position.file];
+	board.en_passant = false;
+	switch (type) {
+	case CAPTURE:
+	case CAPTURE_WITH_PROMOTION:
+		undo.captured = static_cast<piece_types>(board.mailbox[destination]);
+		undo.captured_promoted = (board.promoted >> destination) & 1;
+		board.remove_piece(destination);
+		board.halfmove_clock = 0;
+		break;
+	case EN_PASSANT:
+		undo.captured = PAWN;
+		board.remove_piece(board.player_to_move ? destination + 8 : destination - 8);
+		break;
+	case LONG_PAWN_MOVE:
+		board.en_passant = true;
+		board.en_passant_position = square_position((source + destination) / 2);
+		board.key ^= zobrist.en_passant[board.en_passant_position.file];
+		break;
+	default:
+		break;
 	}
-	board[destination.file][destination.rank]._piece->set_position(destination.file, destination.rank);
-	return true;
+	switch (type) {
+	case PROMOTION:
+	case CAPTURE_WITH_PROMOTION:
+		board.remove_piece(source);
+		board.put_piece(board.player_to_move, move.promotion(), destination, true);
+		break;
+	case CASTLES: {//destination is the square of the rook
+		int rank = source / 8 * 8;
+		bool queen_side = destination < source;
+		board.remove_piece(source);
+		board.remove_piece(destination);
+		board.put_piece(board.player_to_move, KING, rank + (queen_side ? 2 : 6));
+		board.put_piece(board.player_to_move, ROOK, rank + (queen_side ? 3 : 5));
+		break;
+	}
+	default:
+		board.move_piece(source, destination);
+		break;
+	}
+	if (board.player_to_move == BLACK) ++board.fullmove_number;
+	board.player_to_move = !board.player_to_move;
+	board.key ^= zobrist.side;
 }
 
-bool capture_move(Position source, Position destination, bool checking = false) {
-	auto temp = board[destination.file][destination.rank]._piece;
-	board[destination.file][destination.rank]._piece = board[source.file][source.rank]._piece;
-	board[source.file][source.rank]._piece = new no_piece(source.file, source.rank);
-	if (!check_king()) {
-		std::cout << "Error: your king is in check after the move" << std::endl;
-		board[source.file][source.rank]._piece = board[destination.file][destination.rank]._piece;
-		board[destination.file][destination.rank]._piece = temp; //    ?
-		return false;
-	}
-	if (checking) {
-		board[source.file][source.rank]._piece = board[destination.file][destination.rank]._piece;
-		board[destination.file][destination.rank]._piece = temp; //    ?
-		return true;
-	}
-	board[destination.file][destination.rank]._piece->set_position(destination.file, destination.rank);
-	return true;
-}
-
-bool en_passant_move(Position source, Position destination, bool checking = false) {
-	piece *temp;
-	if (!player_to_move) {
-		temp = board[destination.file][destination.rank - 1]._piece;
-		board[destination.file][destination.rank - 1]._piece = new no_piece(destination.file, destination.rank - 1);
+void unmake_move(Board& board) {
+	const Undo& undo = board.undo_stack[--board.undo_cnt % MAX_UNDO];
+	int source = undo.move.source(), destination = undo.move.destination();
+	move_types type = undo.move.move_type();
+	board.player_to_move = !board.player_to_move;
+	if (board.player_to_move == BLACK) --board.fullmove_number;
+	switch (type) {
+	case PROMOTION:
+	case CAPTURE_WITH_PROMOTION:
+		board.remove_piece(destination);
+		board.put_piece(board.player_to_move, PAWN, source);
+		break;
+	case CASTLES: {
+		int rank = source / 8 * 8;
+		bool queen_side = destination < source;
+		board.remove_piece(rank + (queen_side ? 2 : 6));
+		board.remove_piece(rank + (queen_side ? 3 : 5));
+		board.put_piece(board.player_to_move, KING, source);
+		board.put_piece(board.player_to_move, ROOK, destination);
+		break;
 	}
-	else {
-		temp = board[destination.file][destination.rank + 1]._piece;
-		board[destination.file][destination.rank + 1]._piece = new no_piece(destination.file, destination.rank + 1);
+	default:
+		board.move_piece(destination, source);
+		break;
 	}
-	board[destination.file][destination.rank]._piece = board[source.file][source.rank]._piece;
-	board[source.file][source.rank]._piece = new no_piece(source.file, source.rank);
-	if (!check_king()) {
-		if (!player_to_move) {
-			board[destination.file][destination.rank - 1]._piece = temp;
-		}
-		else {
-			board[destination.file][destination.rank + 1]._piece = temp;
-		}
-		std::cout << "Error: your king is in check after the move" << std::endl;
-		board[source.file][source.rank]._piece = board[destination.file][destination.rank]._piece;
-		board[destination.file][destination.rank]._piece = new no_piece(source.file, source.rank);
-		return false;
+	if (type == EN_PASSANT) {
+		board.put_piece(!board.player_to_move, PAWN, board.player_to_move ? destination + 8 : destination - 8);
 	}
-	if (checking) {
-		if (!player_to_move) {
-			board[destination.file][destination.rank - 1]._piece = temp;
-		}
-		else {
-			board[destination.file][destination.rank + 1]._piece = temp;
-		}
-		board[source.file][source.rank]._piece = board[destination.file][destination.rank]._piece;
-		board[destination.file][destination.rank]._piece = new no_piece(source.file, source.rank);
-		return true;
+	else if (undo.captured != EMPTY) {
+		board.put_piece(!board.player_to_move, undo.captured, destination, undo.captured_promoted);
 	}
-	board[destination.file][destination.rank]._piece->set_position(destination.file, destination.rank);
-	return true;
+	memcpy(board.castle, undo.castle, sizeof(board.castle));
+	board.en_passant = undo.en_passant;
+	board.en_passant_position = undo.en_passant_position;
+	board.halfmove_clock = undo.halfmove_clock;
+	board.key = undo.key; //put_piece and remove_piece above changed it as well
 }
 
-bool promotion(Position source, Position destination, bool capture = false) { //  
-	bool res;
-	capture ? res = capture_move(source, destination) : res = no_capture_move(source, destination);
-	bool b = true;
-	while (b) {
+piece_types choose_promotion() {
+	while (true) {
 		char c;
 		std::cout << "Choose the piece you want to promote your pawn into:" << std::endl;
 		std::cout << "q - Queen" << std::endl;
@@ -1798,190 +1561,328 @@ bool promotion(Position source, Position destination, bool capture = false) { //
 		std::cout << "n - Knight" << std::endl;
 		std::cin >> c;
 		std::cout << std::endl;
-		b = false;
 		switch (c) {
 		case 'q':
-			board[destination.file][destination.rank]._piece = new queen(player_to_move, destination.file, destination.rank, true);
-			break;
+			return QUEEN;
 		case 'r':
-			board[destination.file][destination.rank]._piece = new rook(player_to_move, destination.file, destination.rank, true);
-			break;
+			return ROOK;
 		case 'b':
-			board[destination.file][destination.rank]._piece = new bishop(player_to_move, destination.file, destination.rank, true);
-			break;
+			return BISHOP;
 		case 'n':
-			board[destination.file][destination.rank]._piece = new knight(player_to_move, destination.file, destination.rank, true);
-			break;
+			return KNIGHT;
 		default:
 			std::cout << "Error: invalid input. Try again:" << std::endl;
-			b = true;
 			break;
 		}
 	}
-	return res;
 }
-//bool checking???????
-bool castling_move(Position source, Position destination) {
-	return true;
+
+bool no_legal_moves(const Board& board) {
+	Move_list moves;
+	generate_moves(board, compute_legality(board), moves);
+	return moves.amount() == 0;
 }
-//bool checking???????
-bool check_checkmate() {//   return true if king is under checkmate
-	if (check_king()) return false;
-	Position king_position = find_king();
-	mark_attacked();
-	board[king_position.file][king_position.rank]._piece->moves.clear();
-	board[king_position.file][king_position.rank]._piece->find(false);
-	for (auto i = 0; i < board[king_position.file][king_position.rank]._piece->moves.amount(); ++i) {
-		Position j = board[king_position.file][king_position.rank]._piece->moves[i].destination;
-		if (!board[j.file][j.rank].is_attacked()) {
-			unmark_attacked();
-			return false;
-		}
-	}
-	unmark_attacked();
-	if (checking_pieces.amount() > 1) return true;
-	Position checking_piece_position = checking_pieces[0].position;
-	if (checking_pieces[0].piece_type == KNIGHT) {
-		for (auto i = 0; i < 8; ++i) {
-			for (auto j = 0; j < 8; ++j) {
-				if (board[i][j].color() == player_to_move) {
-					board[i][j]._piece->moves.clear();
-					board[i][j]._piece->find(false);
-					for (auto k = 0; k < board[i][j]._piece->moves.amount(); ++k) {
-						if (board[i][j]._piece->moves[k].destination == checking_piece_position) {
-							if (capture_move(board[i][j]._piece->moves[k].destination, checking_piece_position, true)) return false;
-						}
-					}
-				}
-			}
+
+class Mapped_file {//read-only view of a whole file; the OS pages it in as the reader walks through, so memory use does not grow with the file
+public:
+
+	explicit Mapped_file(const char* path) : data(nullptr), size(0) {
+#if defined(_WIN32)
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) throw "Cannot open file";
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size)) {
+			CloseHandle(file);
+			throw "Cannot read file size";
+		}
+		size = static_cast<std::size_t>(file_size.QuadPart);
+		mapping = size ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+		if (size && !mapping) {
+			CloseHandle(file);
+			throw "Cannot map file";
 		}
+		if (size) data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+		file = open(path, O_RDONLY);
+		if (file < 0) throw "Cannot open file";
+		struct stat st;
+		if (fstat(file, &st) < 0) {
+			close(file);
+			throw "Cannot read file size";
+		}
+		size = static_cast<std::size_t>(st.st_size);
+		if (size) {
+			void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (view == MAP_FAILED) {
+				close(file);
+				throw "Cannot map file";
+			}
+			madvise(view, size, MADV_SEQUENTIAL);
+			data = static_cast<const char*>(view);
+		}
+#endif
 	}
-	if (checking_pieces[0].piece_type == PAWN) {
-		for (auto i = 0; i < 8; ++i) {
-			for (auto j = 0; j < 8; ++j) {
-				if (board[i][j].color() == player_to_move) {
-					board[i][j]._piece->moves.clear();
-					board[i][j]._piece->find(false);
-					for (auto k = 0; k < board[i][j]._piece->moves.amount(); ++k) {
-						if (board[i][j]._piece->moves[k].destination == checking_piece_position) {
-							if (board[i][j]._piece->moves[k].move_type == CAPTURE) {
-								if (capture_move(board[i][j]._piece->moves[k].destination, checking_piece_position, true)) return false;
-							}
-							if (board[i][j]._piece->moves[k].move_type == EN_PASSANT) {
-								if (en_passant_move(board[i][j]._piece->moves[k].destination, checking_piece_position, true)) return false;
-							}
-						}
-					}
-				}
+
+	Mapped_file(const Mapped_file&) = delete;
+	Mapped_file& operator=(const Mapped_file&) = delete;
+
+	~Mapped_file() {
+#if defined(_WIN32)
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(file);
+#else
+		if (data) munmap(const_cast<char*>(data), size);
+		close(file);
+#endif
+	}
+
+	const char* begin() const {
+		return data;
+	}
+
+	const char* end() const {
+		return data + size;
+	}
+
+private:
+
+	const char* data;
+
+	std::size_t size;
+
+#if defined(_WIN32)
+	HANDLE file;
+
+	HANDLE mapping;
+#else
+	int file;
+#endif
+};
+
+bool parse_san(const Board& board, const char* san, const char* end, Move& move) {//finds the legal move a SAN token names
+	while (end > san && end[-1] && strchr("+#!?", end[-1])) --end; //check marks and annotations
+	if (end - san < 2) return false;
+	Move_list moves;
+	generate_moves(board, compute_legality(board), moves);
+
+	if (*san == 'O' || *san == '0') {
+		bool queen_side = end - san >= 5;
+		for (auto candidate : moves) {
+			if (candidate.move_type() == CASTLES && (candidate.destination() < candidate.source()) == queen_side) {
+				move = candidate;
+				return true;
 			}
 		}
+		return false;
 	}
-	if (checking_pieces[0].piece_type == QUEEN) {
-		for (auto i = 0; i < 8; ++i) {
-			for (auto j = 0; j < 8; ++j) {
-				if (board[i][j].color() == player_to_move) { //  
-					board[i][j]._piece->moves.clear();
-					board[i][j]._piece->find(false);
-					for (auto k = 0; k < board[i][j]._piece->moves.amount(); ++k) {
-						if (board[i][j]._piece->moves[k].destination == checking_piece_position) {
-							if (capture_move(board[i][j]._piece->moves[k].destination, checking_piece_position, true)) return false;
-						}
-					}
-					if (king_position.file == i) {
-						auto diff = king_position.rank - j;
-						if (diff > 1) {
-							for (auto k = 0; k < board[i][j]._piece->moves.amount(); ++k) {
-								for (auto q = 1; q < diff; ++q) {
-									if (board[i][j]._piece->moves[k].destination == Position(i, king_position.rank + q)) {
-										move_types MT = board[i][j]._piece->moves[k].move_type;
-										bool successful;
-										switch (MT) {
-											//   long_pawn_move
-										}
-									}
-								}
-							}
-						}
-						if (diff < -1) {
-							for (auto k = 0; k < board[i][j]._piece->moves.amount(); ++k) {
-								for (auto q = -1; q > diff; --q) {
-									if (board[i][j]._piece->moves[k].destination == Position(i, king_position.rank + q)) {
-										move_types MT = board[i][j]._piece->moves[k].move_type;
-										bool successful;
-										switch (MT) {
-											//   long_pawn_move
-										}
-									}
-								}
-							}
-						}
-					}
-					if (king_position.rank == j) {
-						auto diff = king_position.file - i;
-						if (diff > 1) {
 
-						}
-						if (diff < -1) {
+	piece_types piece = PAWN, promotion = EMPTY;
+	if (strchr("KQRBN", *san)) piece = static_cast<piece_types>(strchr(piece_chars, *san | 0x20) - piece_chars), ++san;
+	if (end - san >= 3 && strchr("QRBN", end[-1])) {//e8=Q, also e8Q
+		promotion = static_cast<piece_types>(strchr(piece_chars, end[-1] | 0x20) - piece_chars);
+		end -= end[-2] == '=' ? 2 : 1;
+	}
+	if (end - san < 2 || end[-2] < 'a' || end[-2] > 'h' || end[-1] < '1' || end[-1] > '8') return false;
+	int destination = (end[-1] - '1') * 8 + (end[-2] - 'a');
+	int file = -1, rank = -1; //disambiguation
+	for (const char* c = san; c < end - 2; ++c) {
+		if (*c >= 'a' && *c <= 'h') file = *c - 'a';
+		else if (*c >= '1' && *c <= '8') rank = *c - '1';
+		else if (*c != 'x' && *c != ':' && *c != '-') return false;
+	}
 
-						}
-					}
-				}
+	int found = 0;
+	for (auto candidate : moves) {
+		if (candidate.destination() != destination || candidate.move_type() == CASTLES) continue;
+		if (board.mailbox[candidate.source()] != piece || candidate.promotion() != promotion) continue;
+		if ((file >= 0 && candidate.source() % 8 != file) || (rank >= 0 && candidate.source() / 8 != rank)) continue;
+		move = candidate;
+		++found;
+	}
+	return found == 1;
+}
+
+struct Pgn_stats {
+	std::uint64_t games = 0;
+	std::uint64_t moves = 0;
+	std::uint64_t errors = 0; //games with an illegal or unreadable move, or a bad FEN tag
+
+	Pgn_stats& operator+= (const Pgn_stats& other) {
+		games += other.games;
+		moves += other.moves;
+		errors += other.errors;
+		return *this;
+	}
+};
+
+const char* pgn_token_end(const char* p, const char* end) {
+	while (p < end && *p && !strchr(" \t\r\n{}();[]", *p)) ++p;
+	return p;
+}
+
+Pgn_stats read_PGN(const char* p, const char* end) {//replays every game of an in-memory PGN; the text is scanned once and nothing is allocated per game
+	const char* begin = p;
+	Pgn_stats stats;
+	Board board;
+	char fen[MAX_FEN_LENGTH] = "";
+	bool in_game = false, started = false, failed = false;
+	auto finish_game = [&]() {
+		if (in_game) failed ? ++stats.errors : ++stats.games;
+		in_game = started = failed = false;
+		fen[0] = '\0';
+	};
+
+	while (p < end) {
+		char c = *p;
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			++p;
+			continue;
+		}
+		if (c == '[') {//tag pair; a tag after moves means the previous game had no result
+			if (started) finish_game();
+			in_game = true;
+			const char* name = ++p;
+			while (p < end && *p != ' ' && *p != ']') ++p;
+			bool fen_tag = p - name == 3 && !strncmp(name, "FEN", 3);
+			while (p < end && *p != '"' && *p != ']') ++p;
+			const char* value = p < end && *p == '"' ? ++p : p;
+			while (p < end && *p != '"' && *p != '\n') ++p;
+			if (fen_tag && p - value < MAX_FEN_LENGTH) {
+				memcpy(fen, value, p - value);
+				fen[p - value] = '\0';
+			}
+			while (p < end && *p != ']' && *p != '\n') ++p;
+			++p;
+			continue;
+		}
+		if (c == '{') {
+			while (p < end && *p != '}') ++p;
+			++p;
+			continue;
+		}
+		if (c == ';' || (c == '%' && (p == begin || p[-1] == '\n'))) {//comment or escape to the end of the line
+			while (p < end && *p != '\n') ++p;
+			continue;
+		}
+		if (c == '(') {//variations are skipped, comments inside them may contain brackets
+			int depth = 0;
+			for (; p < end; ++p) {
+				if (*p == '{') while (p < end && *p != '}') ++p;
+				else if (*p == '(') ++depth;
+				else if (*p == ')' && --depth == 0) break;
+			}
+			++p;
+			continue;
+		}
+		if (c == ')' || c == '}' || c == ']') {
+			++p;
+			continue;
+		}
+		const char* token = p;
+		p = pgn_token_end(p + 1, end);
+		in_game = true;
+		if (c == '$') continue; //numeric annotation glyph
+		if (c == '*' || (p - token >= 3 && (!strncmp(token, "1-0", 3) || !strncmp(token, "0-1", 3) || !strncmp(token, "1/2", 3)))) {
+			finish_game();
+			continue;
+		}
+		if (c >= '0' && c <= '9' && strncmp(token, "0-0", 3)) {//move number, possibly glued to the move: 12.e4
+			while (token < p && ((*token >= '0' && *token <= '9') || *token == '.')) ++token;
+			if (token == p) continue;
+		}
+		if (failed) continue;
+		if (!started) {
+			started = true;
+			try {
+				set_position(board, fen[0] ? fen : FEN);
+			}
+			catch (const char*) {
+				failed = true;
+				continue;
 			}
 		}
-
+		Move move(0, 0, NO_CAPTURE);
+		if (!parse_san(board, token, p, move)) {
+			failed = true;
+			continue;
+		}
+		make_move(board, move);
+		++stats.moves;
 	}
-	return true;
+	finish_game();
+	return stats;
 }
 
-/*void initialize_rank() {
-	// 
+const char* next_game(const char* p, const char* begin, const char* end) {//the first tag section that starts at or after p, end if there is none
+	for (; p < end; ++p) {
+		if (p == begin) return p; //nothing in front of it to look at
+		if (*p != '[' || p[-1] != '\n') continue;
+		const char* line = p - 1; //a game starts at a tag line that follows a blank line
+		if (line > begin && line[-1] == '\r') --line;
+		if (line == begin || line[-1] == '\n') return p;
+	}
+	return end;
 }
 
-void initialize_settings(char* str) {
+Pgn_stats read_PGN_parallel(const char* begin, const char* end, unsigned int threads) {//games are split in chunks at game boundaries and shared between the threads
+	const std::size_t chunks = threads * 16; //many more chunks than threads, so one slow chunk does not hold up the rest
+	std::vector<const char*> bounds{ begin };
+	for (std::size_t i = 1; i < chunks; ++i) {
+		const char* split = next_game(std::max(bounds.back(), begin + (end - begin) / chunks * i), begin, end);
+		if (split != bounds.back()) bounds.push_back(split);
+	}
+	if (bounds.back() != end) bounds.push_back(end);
 
+	std::vector<Pgn_stats> results(threads);
+	std::atomic<std::size_t> next(0);
+	auto worker = [&](unsigned int thread) {
+		for (std::size_t i; (i = next++) + 1 < bounds.size();) results[thread] += read_PGN(bounds[i], bounds[i + 1]);
+	};
+	std::vector<std::thread> pool;
+	for (auto i = 1u; i < threads; ++i) pool.emplace_back(worker, i);
+	worker(0);
+	for (auto& thread : pool) thread.join();
+
+	Pgn_stats stats;
+	for (const auto& result : results) stats += result;
+	return stats;
 }
 
-void read_PGN(char* PGN) {//  std::string
-	char rank[9];
-	char* temp = PGN;
-	int cnt = 0;
-	for (auto i = 7; i >= 0; i--) {
-		while (*temp != '/') {
-			if (cnt > 8) throw "Error: invalid PGN";
-			rank[cnt] = *temp;
-			++cnt;
-			++temp;
-		}
-		++temp;
-		rank[cnt + 1] = '/';
-		cnt = 0;
-		initialize_rank(rank, i);
-	}
-	while (*temp != ' ') {
-		if (cnt > 8) throw "Error: invalid PGN";
-		rank[cnt] = *temp;
-		++cnt;
-		++temp;
-	}
-	++temp;
-	rank[cnt + 1] = '/';
-	cnt = 0;
-	initialize_rank(rank, 0);
-	while (*temp != '\0') {
-		if (*temp == ' ') {
-			++temp;
-			continue;
+void update_result(Game_state& game) {//results that end the game without a claim
+	const Board& board = game.board;
+	if (no_legal_moves(board)) {
+		if (!check_king(board)) {
+			game.game_result.result = board.player_to_move ? results::WHITE_WINS : results::BLACK_WINS;
+			game.game_result.cause = causes::CHECKMATE;
+		}
+		else {
+			game.game_result.result = results::DRAW;
+			game.game_result.cause = causes::STALEMATE;
 		}
-		rank[cnt] = *temp;
-		++cnt;
-		++temp;
 	}
-	initialize_settings(rank);
-}*/
+	else if (board.repetitions() >= 5) {
+		game.game_result.result = results::DRAW;
+		game.game_result.cause = causes::FIVEFOLD_REPETITION;
+	}
+	else if (board.halfmove_clock >= 150) {
+		game.game_result.result = results::DRAW;
+		game.game_result.cause = causes::BY_75_MOVE_RULE;
+	}
+	else if (board.insufficient_material()) {
+		game.game_result.result = results::DRAW;
+		game.game_result.cause = causes::UNSUFFICIENT_MATERIAL;
+	}
+}
 
-void resignation(bool player) {
-	player ? game_result.result = results::WHITE_WINS : game_result.result = results::BLACK_WINS;
-	game_result.cause = causes::RESIGNATION;
+void play_move(Game_state& game, Move move) {
+	make_move(game.board, move);
+	game.history.push_back(move);
+}
+
+void resignation(Game_state& game, bool player) {
+	player ? game.game_result.result = results::WHITE_WINS : game.game_result.result = results::BLACK_WINS;
+	game.game_result.cause = causes::RESIGNATION;
 }
 
 bool check_move(char* move) {
@@ -1990,14 +1891,30 @@ bool check_move(char* move) {
 	if (move[1] < '1' || move[1] > '8') return false;
 	if (move[2] < 'a' || move[2] > 'h') return false;
 	if (move[3] < '1' || move[3] > '8') return false;
+	return true;
 }
 
-void make_move() {
+void player_move(Game_state& game) {
+	Board& board = game.board;
+	if (board.repetitions() >= 3) std::cout << "The position has occurred three times, enter \"draw\" to claim a draw." << std::endl;
+	else if (board.halfmove_clock >= 100) std::cout << "50 moves have passed without a capture or a pawn move, enter \"draw\" to claim a draw." << std::endl;
 	std::cout << "Enter your move as 4-character string (for instance, e2e4):" << std::endl;
 	char move[5];
 	std::cin >> move;
 	if (!strcmp(move, "res")) {
-		resignation(player_to_move);
+		resignation(game, board.player_to_move);
+		return;
+	}
+	if (!strcmp(move, "draw")) {
+		if (board.repetitions() >= 3) {
+			game.game_result.result = results::DRAW;
+			game.game_result.cause = causes::THREEFOLD_REPETITION;
+		}
+		else if (board.halfmove_clock >= 100) {
+			game.game_result.result = results::DRAW;
+			game.game_result.cause = causes::BY_50_MOVE_RULE;
+		}
+		else std::cout << "Error: a draw can only be claimed after a threefold repetition or 50 moves without a capture or a pawn move" << std::endl;
 		return;
 	}
 	if (!check_move(move)) {
@@ -2006,89 +1923,45 @@ void make_move() {
 	}
 	Position source(static_cast<short>(move[0] - 97), static_cast<short>(move[1] - 49));
 	Position destination(static_cast<short>(move[2] - 97), static_cast<short>(move[3] - 49));
-	if (!board[source.file][source.rank].occupied()) {
+	if (!board.occupied(source.file, source.rank)) {
 		std::cout << "Error: source square does not contain a piece" << std::endl;
 		return;
 	}
-	if (board[source.file][source.rank].color() != player_to_move) {
+	if (board.color(source.file, source.rank) != board.player_to_move) {
 		std::cout << "Error: piece chosen belongs to other player" << std::endl;
 		return;
 	}
 
-	board[source.file][source.rank]._piece->moves.clear();
-	board[source.file][source.rank]._piece->find(false);
-	bool possible = false;
-	unsigned short i = 0;
-	for (; i < board[source.file][source.rank]._piece->moves.amount(); ++i) {
-		if (board[source.file][source.rank]._piece->moves[i].destination == destination) {
-			possible = true;
-			break;
-		}
+	Move_list moves;
+	generate_moves(board, compute_legality(board), moves);
+	int from = source.rank * 8 + source.file, to = destination.rank * 8 + destination.file;
+	int i = 0;
+	for (; i < moves.amount(); ++i) {
+		if (moves[i].source() != from) continue;
+		if (moves[i].destination() == to) break;
+		if (moves[i].move_type() == CASTLES && destination.rank == source.rank &&
+			destination.file == (moves[i].destination() < from ? 2 : 6)) break; //the king's square is accepted as well as the rook's
 	}
-	if (!possible) {
+	if (i == moves.amount()) {
 		std::cout << "Error: impossible move" << std::endl;
 		return;
 	}
 
-	move_types move_type = board[source.file][source.rank]._piece->moves[i].move_type;
-	if (en_passant == true) {
-		en_passant_cnt++;
-		if (en_passant_cnt > 1) {
-			en_passant = false;
-			en_passant_cnt = 0;
-		}
-	}
-	bool successful = false;
-	switch (move_type) {
-	case NO_CAPTURE:
-		successful = no_capture_move(source, destination);
-		break;
-	case CAPTURE:
-		successful = capture_move(source, destination);
-		break;
-	case PROMOTION:
-		successful = promotion(source, destination);
-		break;
-	case CAPTURE_WITH_PROMOTION:
-		successful = promotion(source, destination, true);
-		break;
-	case EN_PASSANT:
-		successful = en_passant_move(source, destination);
-		en_passant = false;
-		break;
-	case LONG_PAWN_MOVE:
-		successful = no_capture_move(source, destination);
-		en_passant = true;
-		en_passant_position.file = source.file;
-		player_to_move ? en_passant_position.rank = source.rank - 1 : en_passant_position.rank = source.rank + 1;
-	case CASTLES://  ?
-		successful = castling_move(source, destination);
-		break;
-	}
-
-	if (successful) {
-		if (board[destination.file][destination.rank].piece_type() == ROOK) {
-			if (player_to_move) {
-				if (source.file == 0) castle[3] = false;
-				if (source.file == 7) castle[2] = false;
-			}
-			else {
-				if (source.file == 0) castle[1] = false;
-				if (source.file == 7) castle[0] = false;
-			}
-		}
-		player_to_move = !player_to_move;
-	}
-	return;
+	Move chosen = moves[i];
+	if (chosen.promotion() != EMPTY) chosen = Move(from, to, chosen.move_type(), choose_promotion());
+	play_move(game, chosen);
 }
 
-void declare_result() {
-	switch (game_result.cause) {
+void declare_result(const Game_state& game) {
+	switch (game.game_result.cause) {
 	case causes::CHECKMATE:
 		std::cout << "Checkmate." << std::endl;
 		break;
+	case causes::STALEMATE:
+		std::cout << "Stalemate." << std::endl;
+		break;
 	case causes::RESIGNATION:
-		player_to_move ? std::cout << "Black " : std::cout << "White ";
+		game.board.player_to_move ? std::cout << "Black " : std::cout << "White ";
 		std::cout << "resigned." << std::endl;
 		break;
 	case causes::AGREEMENT_TO_A_DRAW:
@@ -2120,7 +1993,7 @@ void declare_result() {
 		return;
 		break;
 	}
-	switch (game_result.result) {
+	switch (game.game_result.result) {
 	case results::DRAW:
 		std::cout << "Draw." << std::endl;
 		break;
@@ -2137,26 +2010,1074 @@ void declare_result() {
 	}
 }
 
-int main() {
+class Buffered_writer {//collects output in a fixed buffer and hands it to the stream in large blocks
+public:
+
+	explicit Buffered_writer(std::ostream& stream) : out(stream), used(0) {};
+
+	Buffered_writer(const Buffered_writer&) = delete;
+	Buffered_writer& operator=(const Buffered_writer&) = delete;
+
+	~Buffered_writer() {
+		flush();
+	}
+
+	void write(const char* str, std::size_t length) {
+		if (used + length > sizeof(buffer)) flush();
+		if (length > sizeof(buffer)) out.write(str, length);
+		else {
+			memcpy(buffer + used, str, length);
+			used += length;
+		}
+	}
+
+	void write(const char* str) {
+		write(str, strlen(str));
+	}
+
+	void write(char c) {
+		if (used == sizeof(buffer)) flush();
+		buffer[used++] = c;
+	}
+
+	void flush() {
+		out.write(buffer, used);
+		used = 0;
+	}
+
+private:
+
+	std::ostream& out;
+
+	char buffer[1 << 16];
+
+	std::size_t used;
+};
+
+char* write_san(Board& board, Move move, char* out) {//writes the move in SAN without the terminating zero, returns the end; board is left unchanged
+	int source = move.source(), destination = move.destination();
+	piece_types piece = static_cast<piece_types>(board.mailbox[source]);
+	Move_list moves;
+	generate_moves(board, compute_legality(board), moves);
+	if (move.move_type() == CASTLES) {
+		memcpy(out, destination < source ? "O-O-O" : "O-O", destination < source ? 5 : 3);
+		out += destination < source ? 5 : 3;
+	}
+	else {
+		if (piece != PAWN) {
+			*out++ = static_cast<char>(piece_chars[piece] & ~0x20);
+			bool ambiguous = false, same_file = false, same_rank = false;
+			for (auto other : moves) {
+				if (other.destination() != destination || other.source() == source || board.mailbox[other.source()] != piece || other.move_type() == CASTLES) continue;
+				ambiguous = true;
+				if (other.source() % 8 == source % 8) same_file = true;
+				if (other.source() / 8 == source / 8) same_rank = true;
+			}
+			if (ambiguous && (!same_file || same_rank)) *out++ = static_cast<char>('a' + source % 8);
+			if (ambiguous && same_file) *out++ = static_cast<char>('1' + source / 8);
+		}
+		else if (move.is_capture()) *out++ = static_cast<char>('a' + source % 8);
+		if (move.is_capture()) *out++ = 'x';
+		*out++ = static_cast<char>('a' + destination % 8);
+		*out++ = static_cast<char>('1' + destination / 8);
+		if (move.promotion() != EMPTY) {
+			*out++ = '=';
+			*out++ = static_cast<char>(piece_chars[move.promotion()] & ~0x20);
+		}
+	}
+	make_move(board, move);
+	if (!check_king(board)) *out++ = no_legal_moves(board) ? '#' : '+';
+	unmake_move(board);
+	return out;
+}
+
+const char* result_string(const game_results& game_result) {
+	switch (game_result.result) {
+	case results::WHITE_WINS:
+		return "1-0";
+	case results::BLACK_WINS:
+		return "0-1";
+	case results::DRAW:
+		return "1/2-1/2";
+	default:
+		return "*";
+	}
+}
+
+void write_PGN(const Game_state& game, Buffered_writer& out) {//the seven tag roster, the start position if it is not the classic one and the movetext
+	const char* result = result_string(game.game_result);
+	out.write("[Event \"?\"]\n[Site \"?\"]\n[Date \"????.??.??\"]\n[Round \"?\"]\n[White \"?\"]\n[Black \"?\"]\n[Result \"");
+	out.write(result);
+	out.write("\"]\n");
+	if (game.game_type == game_types::CHESS_960) out.write("[Variant \"Chess960\"]\n");
+	if (strcmp(game.start_fen, FEN)) {
+		out.write("[SetUp \"1\"]\n[FEN \"");
+		out.write(game.start_fen);
+		out.write("\"]\n");
+	}
+	out.write('\n');
+
+	Board board;
+	set_position(board, game.start_fen);
+	const int max_line = 79;
+	int line = 0;
+	auto write_token = [&](const char* token, std::size_t length) {//movetext lines are wrapped before 80 characters
+		if (line && line + 1 + static_cast<int>(length) > max_line) {
+			out.write('\n');
+			line = 0;
+		}
+		if (line) {
+			out.write(' ');
+			++line;
+		}
+		out.write(token, length);
+		line += static_cast<int>(length);
+	};
+	char token[16];
+	for (std::size_t i = 0; i < game.history.size(); ++i) {
+		if (board.player_to_move == WHITE || i == 0) {
+			char* end = write_number(token, board.fullmove_number);
+			memcpy(end, board.player_to_move == WHITE ? "." : "...", board.player_to_move == WHITE ? 1 : 3);
+			write_token(token, end - token + (board.player_to_move == WHITE ? 1 : 3));
+		}
+		write_token(token, write_san(board, game.history[i], token) - token);
+		make_move(board, game.history[i]);
+	}
+	write_token(result, strlen(result));
+	out.write("\n\n");
+}
+
+std::string move_to_string(Move move) {//coordinate notation, castling is written as king takes rook
+	std::string str;
+	str += static_cast<char>('a' + move.source() % 8);
+	str += static_cast<char>('1' + move.source() / 8);
+	str += static_cast<char>('a' + move.destination() % 8);
+	str += static_cast<char>('1' + move.destination() / 8);
+	if (move.promotion() != EMPTY) str += " qrbn"[move.promotion() - KING];
+	return str;
+}
+
+std::uint64_t perft(Board& board, int depth) {
+	Move_list moves;
+	generate_moves(board, compute_legality(board), moves);
+	if (depth <= 1) return depth == 1 ? moves.amount() : 1; //the last ply is counted, not played
+	std::uint64_t nodes = 0;
+	for (auto move : moves) {
+		make_move(board, move);
+		nodes += perft(board, depth - 1);
+		unmake_move(board);
+	}
+	return nodes;
+}
+
+const unsigned int PERFT_HASH_MB = 256; //the most a perft table may take, shallow perfts use less
+
+class Perft_table {//shared by all perft threads without locks
+public:
+
+	explicit Perft_table(std::size_t size_mb) {
+		std::size_t size = 1;
+		while (size * 2 * sizeof(Entry) <= size_mb << 20) size *= 2;
+		entries.reset(new Entry[size]());
+		mask = size - 1;
+	}
+
+	bool probe(std::uint64_t key, int depth, std::uint64_t& nodes) const {
+		key ^= depth_key(depth);
+		const Entry& entry = entries[key & mask];
+		std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+		if ((entry.check.load(std::memory_order_relaxed) ^ data) != key || static_cast<int>(data & 0xFF) != depth) return false;
+		nodes = data >> 8;
+		return true;
+	}
+
+	void store(std::uint64_t key, int depth, std::uint64_t nodes) {
+		key ^= depth_key(depth);
+		Entry& entry = entries[key & mask];
+		std::uint64_t data = nodes << 8 | static_cast<std::uint64_t>(depth);
+		entry.check.store(key ^ data, std::memory_order_relaxed); //a torn entry fails the check in probe() instead of giving a wrong count
+		entry.data.store(data, std::memory_order_relaxed);
+	}
+
+private:
+
+	struct Entry {
+		std::atomic<std::uint64_t> check;
+		std::atomic<std::uint64_t> data; //node count << 8 | depth
+	};
+
+	static std::uint64_t depth_key(int depth) {//the same position at different depths goes to different slots
+		return static_cast<std::uint64_t>(depth) * 0x9E3779B97F4A7C15ULL;
+	}
+
+	std::unique_ptr<Entry[]> entries;
+
+	std::size_t mask;
+};
+
+std::uint64_t perft_hashed(Board& board, int depth, Perft_table& table) {
+	Move_list moves;
+	generate_moves(board, compute_legality(board), moves);
+	if (depth <= 1) return depth == 1 ? moves.amount() : 1;
+	std::uint64_t key = board.key, nodes = 0;
+	assert(key == position_key(board));
+	if (table.probe(key, depth, nodes)) return nodes;
+	for (auto move : moves) {
+		make_move(board, move);
+		nodes += perft_hashed(board, depth - 1, table);
+		unmake_move(board);
+	}
+	table.store(key, depth, nodes);
+	return nodes;
+}
+
+std::uint64_t parallel_perft(const Board& root, int depth, unsigned int threads, bool divide) {//the first two plies are split between the threads
+	Move_list root_moves;
+	generate_moves(root, compute_legality(root), root_moves);
+	if (depth < 2) {//nothing to split
+		Board board = root;
+		std::uint64_t nodes = perft(board, depth);
+		if (divide) {
+			if (depth == 1) {
+				for (auto move : root_moves) std::cout << move_to_string(move) << ": 1" << std::endl;
+			}
+			std::cout << std::endl << "Nodes: " << nodes << std::endl;
+		}
+		return nodes;
+	}
+
+	struct Work {
+		int root_move;
+		Move move;
+	};
+	std::vector<Work> work;
+	Board board = root;
+	for (auto i = 0; i < root_moves.amount(); ++i) {
+		Move_list moves;
+		make_move(board, root_moves[i]);
+		generate_moves(board, compute_legality(board), moves);
+		unmake_move(board);
+		for (auto move : moves) work.push_back({ i, move });
+	}
+
+	Perft_table table(std::min(PERFT_HASH_MB, 1u << std::min(2 * std::max(depth - 3, 0), 8))); //1 MB at depth 3, 4 times more per ply
+	std::vector<std::atomic<std::uint64_t>> counts(root_moves.amount());
+	std::atomic<std::size_t> next(0);
+	auto worker = [&]() {
+		Board board = root; //every thread works on its own copy
+		for (std::size_t i; (i = next++) < work.size();) {
+			make_move(board, root_moves[work[i].root_move]);
+			make_move(board, work[i].move);
+			counts[work[i].root_move] += perft_hashed(board, depth - 2, table);
+			unmake_move(board);
+			unmake_move(board);
+		}
+	};
+	std::vector<std::thread> pool;
+	for (auto i = 1u; i < threads; ++i) pool.emplace_back(worker);
+	worker();
+	for (auto& thread : pool) thread.join();
+
+	std::uint64_t nodes = 0;
+	for (auto i = 0; i < root_moves.amount(); ++i) {
+		if (divide) std::cout << move_to_string(root_moves[i]) << ": " << counts[i] << std::endl;
+		nodes += counts[i];
+	}
+	if (divide) std::cout << std::endl << "Nodes: " << nodes << std::endl;
+	return nodes;
+}
+
+struct Bench_position {
+	const char* fen;
+	int depth;
+	std::uint64_t nodes;
+};
+
+const Bench_position bench_positions[] = {
+	{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5, 4865609 },
+	{ "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 4085603 }, //Kiwipete
+	{ "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624 }, //en passant pins
+	{ "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 422333 }, //promotions
+	{ "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, 2103487 },
+	{ "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594 },
+};
+
+const int BENCH_960_POSITIONS = 4;
+const int BENCH_960_DEPTH = 4;
+
+bool bench() {//returns false if any position gives a wrong node count
+	Board board;
+	bool passed = true;
+	std::uint64_t total_nodes = 0;
+	auto run = [&](const char* name, int depth, std::uint64_t expected) {
+		auto start = std::chrono::steady_clock::now();
+		std::uint64_t nodes = perft(board, depth);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		total_nodes += nodes;
+		std::cout << name << " depth " << depth << ": " << nodes << " nodes, " << static_cast<std::uint64_t>(nodes / (seconds > 0 ? seconds : 1e-9)) << " nps";
+		if (expected && nodes != expected) {
+			std::cout << " (expected " << expected << ")";
+			passed = false;
+		}
+		std::cout << std::endl;
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	for (const auto& position : bench_positions) {
+		set_position(board, position.fen);
+		run(position.fen, position.depth, position.nodes);
+	}
+	srand(960); //the same Chess960 starts on every run
+	for (auto i = 0; i < BENCH_960_POSITIONS; ++i) {
+		initialize_960(board);
+		std::string name = "Chess960 start ";
+		for (auto file = 0; file < 8; ++file) name += " KQRBNP"[board.mailbox[file]];
+		run(name.c_str(), BENCH_960_DEPTH, 0);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << std::endl << "Total: " << total_nodes << " nodes, " << static_cast<std::uint64_t>(total_nodes / (seconds > 0 ? seconds : 1e-9)) << " nps" << std::endl;
+	std::cout << (passed ? "All node counts are correct." : "Error: node count mismatch") << std::endl;
+	return passed;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const int MAX_PLY = 128;
+const int INFINITE_SCORE = 32000;
+const int MATE_SCORE = 31000; //mate in n plies scores MATE_SCORE - n
+const int piece_values[7]{ 0, 0, 900, 500, 330, 320, 100 }; //by piece_types
+
+const short doubled_mg = -10, doubled_eg = -20;
+const short isolated_mg = -10, isolated_eg = -15;
+const short backward_mg = -8, backward_eg = -10;
+const short passed_mg[8]{ 0, 0, 5, 10, 20, 35, 60, 0 }; //by rank, counted from the pawn's own side
+const short passed_eg[8]{ 0, 10, 15, 25, 45, 70, 110, 0 };
+const short shield_bonus[2]{ 12, 6 }; //own pawn one or two ranks in front of the king, midgame only
+
+inline bitboard fill_forward(bitboard b, bool color) {//b and every square in front of it
+	if (color == WHITE) {
+		b |= b << 8;
+		b |= b << 16;
+		b |= b << 32;
+	}
+	else {
+		b |= b >> 8;
+		b |= b >> 16;
+		b |= b >> 32;
+	}
+	return b;
+}
+
+inline bitboard adjacent_files(bitboard b) {
+	return ((b & ~0x0101010101010101ULL) >> 1) | ((b & ~0x8080808080808080ULL) << 1);
+}
+
+const int PAWN_TABLE_SIZE = 1 << 14; //entries per search thread
+
+class Pawn_table {//caches the pawn structure terms by pawn key; each search thread owns one, so there is no locking
+public:
+
+	struct Entry {
+		std::uint64_t key;
+		short mg; //from white's point of view
+		short eg;
+		unsigned char king_squares[2]; //the shields below were computed for these
+		short shield[2]; //[color]
+	};
+
+	Pawn_table() {
+		clear();
+	}
+
+	void clear() {
+		memset(entries, 0, sizeof(entries));
+		for (auto& entry : entries) entry.key = ~0ULL; //so that the pawnless key 0 is not a false hit
+		probes = hits = 0;
+	}
+
+	Entry& probe(const Board& board) {//the structure is computed only on a miss, the shields only when a king has moved
+		Entry& entry = entries[board.pawn_key & (PAWN_TABLE_SIZE - 1)];
+		++probes;
+		if (entry.key == board.pawn_key) ++hits;
+		else {
+			entry.key = board.pawn_key;
+			evaluate_pawns(board, entry);
+			entry.king_squares[WHITE] = entry.king_squares[BLACK] = 64;
+		}
+		for (auto color = 0; color < 2; ++color) {
+			int king_square = lsb(board.pieces[color][KING]);
+			if (entry.king_squares[color] != king_square) {
+				entry.king_squares[color] = king_square;
+				entry.shield[color] = pawn_shield(board, color, king_square);
+			}
+		}
+		return entry;
+	}
+
+	std::uint64_t probes; //hit rate counters, reset by clear()
+
+	std::uint64_t hits;
+
+private:
+
+	static void evaluate_pawns(const Board& board, Entry& entry) {//doubled, isolated, backward and passed pawns
+		entry.mg = entry.eg = 0;
+		for (auto color = 0; color < 2; ++color) {
+			bitboard own = board.pieces[color][PAWN], enemy = board.pieces[!color][PAWN];
+			int forward = color ? -8 : 8;
+			bitboard behind_own = fill_forward(shift_bb(own, -forward), !color);
+			bitboard enemy_span = fill_forward(shift_bb(enemy, -forward), !color); //squares enemy pawns can still reach or attack
+			bitboard enemy_attacks = shift_bb(adjacent_files(enemy), -forward);
+			bitboard own_files = fill_forward(own, WHITE) | fill_forward(own, BLACK);
+			bitboard doubled = own & behind_own; //the rear pawns
+			bitboard isolated = own & ~adjacent_files(own_files);
+			bitboard backward = own & ~isolated & ~fill_forward(adjacent_files(own), color) & shift_bb(enemy_attacks, -forward); //no neighbour level or behind, stop square attacked
+			bitboard passed = own & ~doubled & ~(enemy_span | adjacent_files(enemy_span));
+			int mg = doubled_mg * popcount(doubled) + isolated_mg * popcount(isolated) + backward_mg * popcount(backward);
+			int eg = doubled_eg * popcount(doubled) + isolated_eg * popcount(isolated) + backward_eg * popcount(backward);
+			while (passed) {
+				int rank = pop_lsb(passed) / 8;
+				if (color) rank = 7 - rank;
+				mg += passed_mg[rank];
+				eg += passed_eg[rank];
+			}
+			entry.mg += color ? -mg : mg;
+			entry.eg += color ? -eg : eg;
+		}
+	}
+
+	static short pawn_shield(const Board& board, bool color, int king_square) {
+		int forward = color ? -8 : 8;
+		bitboard front = shift_bb((1ULL << king_square) | adjacent_files(1ULL << king_square), forward);
+		bitboard own = board.pieces[color][PAWN];
+		return shield_bonus[0] * popcount(own & front) + shield_bonus[1] * popcount(own & shift_bb(front, forward));
+	}
+
+	Entry entries[PAWN_TABLE_SIZE];
+};
+
+int evaluate(const Board& board, Pawn_table& pawn_table) {//midgame and endgame sums blended by the material left, from the side to move's point of view
+	const Pawn_table::Entry& pawns = pawn_table.probe(board);
+	int phase = std::min(board.phase, MAX_PHASE);
+	int mg = board.psq_mg + pawns.mg + pawns.shield[WHITE] - pawns.shield[BLACK];
+	int eg = board.psq_eg + pawns.eg;
+	int score = (mg * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+	return board.player_to_move ? -score : score;
+}
+
+void* allocate_large(std::size_t size) {//huge pages where the OS gives them, normal pages otherwise
+#if defined(_WIN32)
+	void* memory = nullptr;
+	SIZE_T large_page = GetLargePageMinimum();
+	if (large_page) memory = VirtualAlloc(nullptr, (size + large_page - 1) / large_page * large_page, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE); //needs the "Lock pages in memory" privilege
+	if (!memory) memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!memory) throw "Out of memory";
+	return memory;
+#else
+	const std::size_t huge_page = 2 << 20;
+	std::size_t rounded = (size + huge_page - 1) / huge_page * huge_page;
+	void* memory = nullptr;
+	if (posix_memalign(&memory, huge_page, rounded)) throw "Out of memory";
+#if defined(MADV_HUGEPAGE)
+	madvise(memory, rounded, MADV_HUGEPAGE);
+#endif
+	return memory;
+#endif
+}
+
+void free_large(void* memory) {
+#if defined(_WIN32)
+	if (memory) VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	free(memory);
+#endif
+}
+
+enum bounds {
+	BOUND_NONE,
+	BOUND_UPPER, //the score is at most this (no move reached alpha)
+	BOUND_LOWER, //the score is at least this (beta cutoff)
+	BOUND_EXACT,
+};
+
+struct Tt_entry_data {
+	Move move;
+	int score;
+	int depth;
+	bounds bound;
+};
+
+const unsigned int TT_DEFAULT_MB = 64;
+
+class Transposition_table {//shared by all search threads without locks
+public:
+
+	explicit Transposition_table(std::size_t size_mb) : buckets(nullptr), bucket_cnt(0), generation(0) {
+		resize(size_mb);
+	}
+
+	Transposition_table(const Transposition_table&) = delete;
+	Transposition_table& operator=(const Transposition_table&) = delete;
+
+	~Transposition_table() {
+		free_large(buckets);
+	}
+
+	void resize(std::size_t size_mb) {
+		free_large(buckets);
+		bucket_cnt = 1;
+		while (bucket_cnt * 2 * sizeof(Bucket) <= size_mb << 20) bucket_cnt *= 2;
+		buckets = static_cast<Bucket*>(allocate_large(bucket_cnt * sizeof(Bucket)));
+		clear();
+	}
+
+	void clear() {
+		memset(static_cast<void*>(buckets), 0, bucket_cnt * sizeof(Bucket));
+		generation = 0;
+	}
+
+	void new_search() {//entries from older searches are replaced first
+		generation = (generation + 1) & 63;
+	}
+
+	bool probe(std::uint64_t key, Tt_entry_data& result) const {
+		const Bucket& bucket = buckets[key & (bucket_cnt - 1)];
+		for (const auto& entry : bucket.entries) {
+			std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+			if ((entry.check.load(std::memory_order_relaxed) ^ data) != key) continue; //empty, another position, or torn by a concurrent write
+			result.move = Move::from_raw(static_cast<std::uint16_t>(data));
+			result.score = static_cast<std::int16_t>(data >> 16);
+			result.depth = static_cast<int>((data >> 32) & 0xFF);
+			result.bound = static_cast<bounds>((data >> 40) & 3);
+			return true;
+		}
+		return false;
+	}
+
+	void store(std::uint64_t key, Move move, int score, int depth, bounds bound) {
+		Bucket& bucket = buckets[key & (bucket_cnt - 1)];
+		Entry* replace = &bucket.entries[0];
+		int replace_worth = INT32_MAX;
+		for (auto& entry : bucket.entries) {
+			std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+			if ((entry.check.load(std::memory_order_relaxed) ^ data) == key) {
+				if (move == Move()) move = Move::from_raw(static_cast<std::uint16_t>(data)); //keep the old best move
+				replace = &entry;
+				break;
+			}
+			int age = (generation - static_cast<int>(data >> 42)) & 63;
+			int worth = static_cast<int>((data >> 32) & 0xFF) - 8 * age; //shallow and old entries go first
+			if (worth < replace_worth) {
+				replace_worth = worth;
+				replace = &entry;
+			}
+		}
+		std::uint64_t data = move.raw() | static_cast<std::uint64_t>(static_cast<std::uint16_t>(score)) << 16 |
+			static_cast<std::uint64_t>(depth & 0xFF) << 32 | static_cast<std::uint64_t>(bound) << 40 | static_cast<std::uint64_t>(generation) << 42;
+		replace->check.store(key ^ data, std::memory_order_relaxed);
+		replace->data.store(data, std::memory_order_relaxed);
+	}
+
+	std::size_t size_mb() const {
+		return bucket_cnt * sizeof(Bucket) >> 20;
+	}
+
+private:
+
+	struct Entry {
+		std::atomic<std::uint64_t> check; //key ^ data
+		std::atomic<std::uint64_t> data; //move 16 bits, score 16, depth 8, bound 2, generation 6
+	};
+
+	struct alignas(64) Bucket {//one cache line
+		Entry entries[4];
+	};
+
+	static_assert(sizeof(Entry) == 16, "a transposition table entry must fit in 16 bytes");
+	static_assert(sizeof(Bucket) == 64, "a bucket must fill exactly one cache line");
+
+	Bucket* buckets;
+
+	std::size_t bucket_cnt;
+
+	int generation;
+};
+
+int score_to_tt(int score, int ply) {//mate scores are stored relative to the node, not the root
+	if (score > MATE_SCORE - MAX_PLY) return score + ply;
+	if (score < -MATE_SCORE + MAX_PLY) return score - ply;
+	return score;
+}
+
+int score_from_tt(int score, int ply) {
+	if (score > MATE_SCORE - MAX_PLY) return score - ply;
+	if (score < -MATE_SCORE + MAX_PLY) return score + ply;
+	return score;
+}
+
+struct Search_limits {
+	int depth = MAX_PLY;
+	int time_ms = 0; //0 means no time limit
+};
+
+struct Search_state {//everything one search thread owns; threads share only the transposition table and the stop flag
+	Board board;
+	Transposition_table* tt;
+	Search_limits limits;
+	std::chrono::steady_clock::time_point start;
+	std::atomic<bool>* stop;
+	std::atomic<std::uint64_t> nodes{ 0 }; //written by its own thread only, summed up by the main thread
+	int thread_id = 0;
+	Move pv[MAX_PLY][MAX_PLY]; //triangular table, pv[ply] is the best line found from ply on
+	int pv_length[MAX_PLY];
+	Move killers[MAX_PLY][2]; //quiet moves that caused a beta cutoff at the same ply
+	int history[2][64][64]; //[color][source][destination], how often a quiet move caused a cutoff
+	Pawn_table pawn_table;
+};
+
+int elapsed_ms(const Search_state& state) {
+	return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - state.start).count());
+}
+
+void count_node(Search_state& state) {//only the main thread looks at the clock
+	std::uint64_t nodes = state.nodes.load(std::memory_order_relaxed) + 1;
+	state.nodes.store(nodes, std::memory_order_relaxed);
+	if (!state.thread_id && state.limits.time_ms && (nodes & 2047) == 0 && elapsed_ms(state) >= state.limits.time_ms) state.stop->store(true, std::memory_order_relaxed);
+}
+
+bool stopped(const Search_state& state) {
+	return state.stop->load(std::memory_order_relaxed);
+}
+
+const int MAX_HISTORY = 16384;
+
+int mvv_lva(const Board& board, Move move) {//most valuable victim first, least valuable attacker among equal victims
+	int victim = move.move_type() == EN_PASSANT ? static_cast<int>(PAWN) : board.mailbox[move.destination()];
+	return 10 * piece_values[victim] + piece_values[move.promotion()] - piece_values[board.mailbox[move.source()]] / 100;
+}
+
+bool see(const Board& board, Move move, int threshold) {//static exchange evaluation: does the capture sequence on the destination win at least threshold? Nothing is played on the board
+	static const int see_values[7]{ 0, 20000, 900, 500, 330, 320, 100 }; //the king is never given up
+	if (move.move_type() == CASTLES) return threshold <= 0;
+	int source = move.source();
+	int destination = move.destination();
+	int attacker = board.mailbox[source];
+	int swap = (move.move_type() == EN_PASSANT ? see_values[PAWN] : see_values[board.mailbox[destination]]) - threshold;
+	if (move.promotion() != EMPTY) {
+		swap += see_values[move.promotion()] - see_values[PAWN];
+		attacker = move.promotion();
+	}
+	if (swap < 0) return false;
+	swap = see_values[attacker] - swap;
+	if (swap <= 0) return true; //even losing the moved piece keeps us at threshold
+
+	bitboard occupied = board.occupied_squares() ^ (1ULL << source) ^ (1ULL << destination);
+	if (move.move_type() == EN_PASSANT) occupied ^= 1ULL << (board.player_to_move == WHITE ? destination - 8 : destination + 8);
+	bitboard bishops = board.pieces[WHITE][BISHOP] | board.pieces[BLACK][BISHOP] | board.pieces[WHITE][QUEEN] | board.pieces[BLACK][QUEEN];
+	bitboard rooks = board.pieces[WHITE][ROOK] | board.pieces[BLACK][ROOK] | board.pieces[WHITE][QUEEN] | board.pieces[BLACK][QUEEN];
+	bitboard attackers = board.attackers_to(destination, occupied);
+	bool side = board.player_to_move;
+	bool result = true;
+	while (true) {
+		side = !side;
+		attackers &= occupied;
+		bitboard own_attackers = attackers & board.occupancy[side];
+		if (!own_attackers) break;
+		result = !result;
+		int type = PAWN;
+		while (type > KING && !(own_attackers & board.pieces[side][type])) --type; //least valuable attacker first
+		if (type == KING) return (attackers & board.occupancy[!side]) ? !result : result; //the king may only take last
+		swap = see_values[type] - swap;
+		if (swap < result) break;
+		occupied ^= 1ULL << lsb(own_attackers & board.pieces[side][type]);
+		if (type == PAWN || type == BISHOP || type == QUEEN) attackers |= bishop_attacks(destination, occupied) & bishops; //x-rays behind the piece that just captured
+		if (type == ROOK || type == QUEEN) attackers |= rook_attacks(destination, occupied) & rooks;
+	}
+	return result;
+}
+
+void update_history(int& entry, int bonus) {//the bigger the entry, the less it grows, so it stays within MAX_HISTORY
+	entry += bonus - entry * std::abs(bonus) / MAX_HISTORY;
+}
+
+enum picker_stages {
+	TT_STAGE,
+	CAPTURE_INIT,
+	CAPTURE_STAGE,
+	KILLER_STAGE,
+	QUIET_INIT,
+	QUIET_STAGE,
+	BAD_CAPTURE_STAGE,
+	DONE_STAGE,
+};
+
+class Move_picker {//hands out moves one at a time: TT move, winning captures by MVV-LVA, killers, quiets by history, losing captures; each group is generated only when it is reached
+public:
+
+	Move_picker(const Board& board, const Legality& legality, Move tt_move, const Move* killers, const int (*history)[64], bool tactical_only) :
+		board(board), legality(legality), tt_move(tt_move), killers{ killers ? killers[0] : Move(), killers ? killers[1] : Move() },
+		history(history), tactical_only(tactical_only), stage(TT_STAGE), index(0), killer_index(0), bad_capture_cnt(0) {};
+
+	Move next() {//Move() when there is nothing left
+		switch (stage) {
+		case TT_STAGE:
+			stage = CAPTURE_INIT;
+			if (tt_move != Move() && (!tactical_only || is_tactical(tt_move)) && is_legal(tt_move)) return tt_move;
+			[[fallthrough]];
+		case CAPTURE_INIT:
+			generate_moves(board, legality, moves, TACTICAL_MOVES);
+			for (auto i = 0; i < moves.amount(); ++i) scores[i] = mvv_lva(board, moves[i]);
+			index = 0;
+			stage = CAPTURE_STAGE;
+			[[fallthrough]];
+		case CAPTURE_STAGE:
+			while (index < moves.amount()) {
+				Move move = pick_best();
+				if (move == tt_move) continue;
+				if (see(board, move, 0)) return move;
+				if (!tactical_only) bad_captures[bad_capture_cnt++] = move; //quiescence does not search losing captures at all
+			}
+			if (tactical_only) {
+				stage = DONE_STAGE;
+				return Move();
+			}
+			stage = KILLER_STAGE;
+			[[fallthrough]];
+		case KILLER_STAGE:
+			while (killer_index < 2) {
+				Move killer = killers[killer_index++];
+				if (killer != Move() && killer != tt_move && (killer_index == 1 || killer != killers[0]) && !is_tactical(killer) && is_legal(killer)) return killer;
+			}
+			stage = QUIET_INIT;
+			[[fallthrough]];
+		case QUIET_INIT:
+			moves.clear();
+			generate_moves(board, legality, moves, QUIET_MOVES);
+			for (auto i = 0; i < moves.amount(); ++i) scores[i] = history[moves[i].source()][moves[i].destination()];
+			index = 0;
+			stage = QUIET_STAGE;
+			[[fallthrough]];
+		case QUIET_STAGE:
+			while (index < moves.amount()) {
+				Move move = pick_best();
+				if (move != tt_move && move != killers[0] && move != killers[1]) return move;
+			}
+			index = 0;
+			stage = BAD_CAPTURE_STAGE;
+			[[fallthrough]];
+		case BAD_CAPTURE_STAGE:
+			if (index < bad_capture_cnt) return bad_captures[index++];
+			stage = DONE_STAGE;
+			[[fallthrough]];
+		default:
+			return Move();
+		}
+	}
+
+private:
+
+	static bool is_tactical(Move move) {
+		return move.is_capture() || move.promotion() != EMPTY;
+	}
+
+	bool is_legal(Move move) const {//TT moves and killers may come from another position
+		if (!(board.occupancy[board.player_to_move] & (1ULL << move.source()))) return false;
+		Move_list candidates;
+		generate_moves(board, legality, candidates, is_tactical(move) ? TACTICAL_MOVES : QUIET_MOVES, 1ULL << move.source());
+		for (auto candidate : candidates) {
+			if (candidate == move) return true;
+		}
+		return false;
+	}
+
+	Move pick_best() {//one step of selection sort, cheaper than sorting when a cutoff comes early
+		int best = index;
+		for (auto i = index + 1; i < moves.amount(); ++i) {
+			if (scores[i] > scores[best]) best = i;
+		}
+		std::swap(moves[best], moves[index]);
+		std::swap(scores[best], scores[index]);
+		return moves[index++];
+	}
+
+	const Board& board;
+
+	const Legality& legality;
+
+	Move tt_move;
+
+	Move killers[2];
+
+	const int (*history)[64];
+
+	bool tactical_only;
+
+	int stage;
+
+	Move_list moves;
+
+	int scores[MAX_MOVES];
+
+	int index;
+
+	int killer_index;
+
+	Move bad_captures[MAX_MOVES]; //in MVV-LVA order
+
+	int bad_capture_cnt;
+};
+
+int quiescence(Search_state& state, int alpha, int beta, int ply) {//captures and promotions only, until the position is quiet
+	Board& board = state.board;
+	count_node(state);
+	int stand_pat = evaluate(board, state.pawn_table);
+	if (ply >= MAX_PLY - 1 || stand_pat >= beta) return stand_pat;
+	if (stand_pat > alpha) alpha = stand_pat;
+
+	Legality legality = compute_legality(board);
+	Move_picker picker(board, legality, Move(), nullptr, nullptr, true);
+	for (Move move; (move = picker.next()) != Move();) {
+		make_move(board, move);
+		int score = -quiescence(state, -beta, -alpha, ply + 1);
+		unmake_move(board);
+		if (stopped(state)) return 0;
+		if (score >= beta) return score;
+		if (score > alpha) alpha = score;
+	}
+	return alpha;
+}
+
+int search(Search_state& state, int alpha, int beta, int depth, int ply) {//negamax alpha-beta with principal variation search
+	Board& board = state.board;
+	state.pv_length[ply] = ply;
+	if (ply && (board.halfmove_clock >= 100 || board.repetitions() >= 2)) return 0;
+	if (depth <= 0 || ply >= MAX_PLY - 1) return quiescence(state, alpha, beta, ply);
+	count_node(state);
+
+	bool pv_node = beta - alpha > 1;
+	Tt_entry_data tt_entry;
+	Move tt_move;
+	if (state.tt->probe(board.key, tt_entry)) {
+		tt_move = tt_entry.move;
+		int tt_score = score_from_tt(tt_entry.score, ply);
+		if (!pv_node && ply && tt_entry.depth >= depth && (tt_entry.bound == BOUND_EXACT ||
+			(tt_entry.bound == BOUND_LOWER && tt_score >= beta) || (tt_entry.bound == BOUND_UPPER && tt_score <= alpha))) return tt_score;
+	}
+
+	Legality legality = compute_legality(board);
+	bool us = board.player_to_move;
+	Move_picker picker(board, legality, tt_move, state.killers[ply], state.history[us], false);
+	int best = -INFINITE_SCORE, old_alpha = alpha, searched = 0, quiet_cnt = 0;
+	Move best_move, quiets[MAX_MOVES];
+	for (Move move; (move = picker.next()) != Move();) {
+		bool quiet = !move.is_capture() && move.promotion() == EMPTY;
+		make_move(board, move);
+		int extension = legality.checkers ? 1 : 0; //do not stop the search in the middle of a check sequence
+		int score;
+		if (!searched) score = -search(state, -beta, -alpha, depth - 1 + extension, ply + 1);
+		else {//the first move is expected to be the best, the rest only have to be proven worse
+			score = -search(state, -alpha - 1, -alpha, depth - 1 + extension, ply + 1);
+			if (score > alpha && score < beta) score = -search(state, -beta, -alpha, depth - 1 + extension, ply + 1);
+		}
+		unmake_move(board);
+		++searched;
+		if (stopped(state)) return 0;
+		if (score > best) {
+			best = score;
+			best_move = move;
+		}
+		if (score > alpha) {
+			alpha = score;
+			state.pv[ply][ply] = move;
+			for (auto next = ply + 1; next < state.pv_length[ply + 1]; ++next) state.pv[ply][next] = state.pv[ply + 1][next];
+			state.pv_length[ply] = state.pv_length[ply + 1];
+			if (alpha >= beta) {
+				if (quiet) {//remember the refutation for siblings and for later visits
+					if (state.killers[ply][0] != move) {
+						state.killers[ply][1] = state.killers[ply][0];
+						state.killers[ply][0] = move;
+					}
+					int bonus = std::min(depth * depth, MAX_HISTORY / 4);
+					update_history(state.history[us][move.source()][move.destination()], bonus);
+					for (auto i = 0; i < quiet_cnt; ++i) update_history(state.history[us][quiets[i].source()][quiets[i].destination()], -bonus);
+				}
+				break;
+			}
+		}
+		if (quiet) quiets[quiet_cnt++] = move;
+	}
+	if (!searched) return legality.checkers ? -MATE_SCORE + ply : 0;
+	state.tt->store(board.key, best_move, score_to_tt(best, ply), depth, best >= beta ? BOUND_LOWER : alpha > old_alpha ? BOUND_EXACT : BOUND_UPPER);
+	return best;
+}
+
+std::string score_to_string(int score) {
+	if (score > MATE_SCORE - MAX_PLY) return "mate " + std::to_string((MATE_SCORE - score + 1) / 2);
+	if (score < -MATE_SCORE + MAX_PLY) return "mate -" + std::to_string((MATE_SCORE + score) / 2);
+	return "cp " + std::to_string(score);
+}
+
+std::uint64_t total_nodes(const std::vector<std::unique_ptr<Search_state>>& states) {
+	std::uint64_t nodes = 0;
+	for (const auto& state : states) nodes += state->nodes.load(std::memory_order_relaxed);
+	return nodes;
+}
+
+Move think(const Board& board, Transposition_table& tt, const Search_limits& limits, unsigned int threads, bool verbose) {//Lazy SMP iterative deepening; returns the main thread's best move of its last finished iteration
+	std::atomic<bool> stop(false);
+	std::vector<std::unique_ptr<Search_state>> states; //too large for the stack
+	for (auto i = 0u; i < std::max(threads, 1u); ++i) {
+		states.emplace_back(new Search_state());
+		states[i]->board = board;
+		states[i]->tt = &tt;
+		states[i]->limits = limits;
+		states[i]->start = std::chrono::steady_clock::now();
+		states[i]->stop = &stop;
+		states[i]->thread_id = i;
+		states[i]->pv_length[0] = 0;
+	}
+	tt.new_search();
+	Search_state& state = *states[0];
+	Move best;
+	{
+		Move_list moves;
+		Legality legality = compute_legality(state.board);
+		generate_moves(state.board, legality, moves);
+		if (!moves.amount()) {//Move(): the game is already over
+			if (verbose) std::cout << "depth 0 score " << (legality.checkers ? "mate 0" : "cp 0") << " nodes 0" << std::endl;
+			return best;
+		}
+		best = moves[0];
+	}
+
+	auto helper = [&](Search_state& helper_state) {//odd helpers start one ply deeper, so the threads do not all search the same depth at once
+		for (auto depth = 1 + helper_state.thread_id % 2; depth <= limits.depth && !stopped(helper_state); ++depth) {
+			search(helper_state, -INFINITE_SCORE, INFINITE_SCORE, depth, 0);
+		}
+	};
+	std::vector<std::thread> helpers;
+	for (auto i = 1u; i < states.size(); ++i) helpers.emplace_back(helper, std::ref(*states[i]));
+
+	for (auto depth = 1; depth <= limits.depth; ++depth) {
+		int score = search(state, -INFINITE_SCORE, INFINITE_SCORE, depth, 0);
+		if (stopped(state)) break;
+		best = state.pv[0][0];
+		if (verbose) {
+			int time = elapsed_ms(state);
+			std::uint64_t nodes = total_nodes(states);
+			std::cout << "depth " << depth << " score " << score_to_string(score) << " nodes " << nodes << " nps " << nodes * 1000 / (time ? time : 1) << " time " << time << " pv";
+			for (auto i = 0; i < state.pv_length[0]; ++i) std::cout << ' ' << move_to_string(state.pv[0][i]);
+			std::cout << std::endl;
+		}
+		if (score > MATE_SCORE - MAX_PLY || score < -MATE_SCORE + MAX_PLY) break;
+		if (limits.time_ms && elapsed_ms(state) * 2 >= limits.time_ms) break; //the next iteration would most likely not finish
+	}
+	stop = true;
+	for (auto& thread : helpers) thread.join();
+	if (verbose) {
+		std::uint64_t probes = 0, hits = 0;
+		for (auto& helper_state : states) {
+			probes += helper_state->pawn_table.probes;
+			hits += helper_state->pawn_table.hits;
+		}
+		std::cout << "pawn hash hits " << (probes ? 100.0 * hits / probes : 0) << "% of " << probes << " probes" << std::endl;
+	}
+	return best;
+}
+
+int main(int argc, char* argv[]) {//chess [fen <fen> | engine <white|black|both> [ms per move] | search <depth> [fen] | pgn <file> [threads] | perft <depth> [fen [threads]] | divide <depth> [fen [threads]] | bench] [--hash <MB>] [--threads <n>]
+	unsigned int hash_mb = TT_DEFAULT_MB, search_threads = 1;
+	int args = 1;
+	for (auto i = 1; i < argc; ++i) {//options may stand anywhere, the rest are positional
+		if (!strcmp(argv[i], "--hash") && i + 1 < argc) hash_mb = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc) search_threads = atoi(argv[++i]);
+		else argv[args++] = argv[i];
+	}
+	argc = args;
+
 	srand(static_cast<int>(time(NULL)));
-	game_type = game_types::CLASSIC;
-	initialize_board();
+	initialize_attack_tables();
+	Game_state game(game_types::CLASSIC);
+	initialize_board(game);
+	std::unique_ptr<Transposition_table> tt; //only the modes that search allocate it
+	bool engine_plays[2]{ false, false };
+	Search_limits engine_limits;
+	engine_limits.time_ms = 1000;
+
+	try {//set_position throws on a bad FEN, Mapped_file on a file it cannot read, allocate_large when it runs out of memory
+		if (argc > 2 && !strcmp(argv[1], "fen")) {//play on from the given position
+			set_position(game.board, argv[2]);
+			write_fen(game.board, game.start_fen);
+		}
+		else if (argc > 2 && !strcmp(argv[1], "engine")) {
+			engine_plays[WHITE] = !strcmp(argv[2], "white") || !strcmp(argv[2], "both");
+			engine_plays[BLACK] = !strcmp(argv[2], "black") || !strcmp(argv[2], "both");
+			if (argc > 3) engine_limits.time_ms = atoi(argv[3]);
+		}
+		else if (argc > 1) {
+			if (!strcmp(argv[1], "bench")) return bench() ? 0 : 1;
+			if (!strcmp(argv[1], "search") && argc > 2) {
+				if (argc > 3) set_position(game.board, argv[3]);
+				Search_limits limits;
+				limits.depth = std::min(atoi(argv[2]), MAX_PLY - 1);
+				tt.reset(new Transposition_table(hash_mb));
+				Move best = think(game.board, *tt, limits, search_threads, true);
+				std::cout << "bestmove " << (best == Move() ? "(none)" : move_to_string(best)) << std::endl;
+				return 0;
+			}
+			if (!strcmp(argv[1], "pgn") && argc > 2) {
+				Mapped_file file(argv[2]);
+				unsigned int threads = argc > 3 ? atoi(argv[3]) : std::thread::hardware_concurrency();
+				auto start = std::chrono::steady_clock::now();
+				Pgn_stats stats = threads > 1 ? read_PGN_parallel(file.begin(), file.end(), threads) : read_PGN(file.begin(), file.end());
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (seconds <= 0) seconds = 1e-9;
+				std::cout << "Games: " << stats.games << ", moves: " << stats.moves << ", games with errors: " << stats.errors << std::endl;
+				std::cout << "Time: " << seconds << " s, " << static_cast<std::uint64_t>(stats.games / seconds) << " games/s, " << static_cast<std::uint64_t>(stats.moves / seconds) << " moves/s" << std::endl;
+				return stats.errors ? 1 : 0;
+			}
+			if ((!strcmp(argv[1], "perft") || !strcmp(argv[1], "divide")) && argc > 2) {
+				if (argc > 3) set_position(game.board, argv[3]);
+				int depth = atoi(argv[2]);
+				unsigned int threads = argc > 4 ? atoi(argv[4]) : std::thread::hardware_concurrency();
+				auto start = std::chrono::steady_clock::now();
+				std::uint64_t nodes = parallel_perft(game.board, depth, threads ? threads : 1, !strcmp(argv[1], "divide"));
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (!strcmp(argv[1], "perft")) std::cout << nodes << std::endl;
+				std::cout << "Time: " << seconds << " s, " << static_cast<std::uint64_t>(nodes / (seconds > 0 ? seconds : 1e-9)) << " nps" << std::endl;
+				return 0;
+			}
+			std::cout << "Usage: " << argv[0] << " [fen <fen> | engine <white|black|both> [ms per move] | search <depth> [fen] | pgn <file> [threads] | perft <depth> [fen [threads]] | divide <depth> [fen [threads]] | bench] [--hash <MB>] [--threads <n>]" << std::endl;
+			return 1;
+		}
+		tt.reset(new Transposition_table(hash_mb)); //for the game below
+	}
+	catch (const char* error) {
+		std::cout << "Error: " << error << std::endl;
+		return 1;
+	}
 
-	while(game_result.result == results::GAME_IN_PROGRESS) {
+	while(game.game_result.result == results::GAME_IN_PROGRESS) {
 		system("CLS");
-		print_board();
-		if (check_checkmate()) {
-			std::cout << "Checkmate" << std::endl;
-			//checkmate(player_to_move);
-			break;
-		}
-		make_move();
+		print_board(game.board);
+		update_result(game);
+		if (game.game_result.result != results::GAME_IN_PROGRESS) break;
+		if (engine_plays[game.board.player_to_move]) play_move(game, think(game.board, *tt, engine_limits, search_threads, false));
+		else player_move(game);
 	}
 
 	system("CLS");
-	print_board();
-	declare_result();
-	delete_board();
+	print_board(game.board);
+	declare_result(game);
+	{
+		Buffered_writer out(std::cout);
+		out.write('\n');
+		write_PGN(game, out);
+	}
 	system("PAUSE");
 
 	return 0;